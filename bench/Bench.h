@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Minimal benchmark runner shared by the bench executables. Each case is
+/// calibrated to run for at least min_time, repeated for a number of samples,
+/// and reported as one JSON object per line (median ns/op and bytes/s).
+/// </summary>
+namespace bench {
+
+	// Keeps the compiler from dropping a computation whose result is unused
+	template <typename T>
+	inline void do_not_optimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	struct Options {
+		std::string filter;        // Only run cases whose name contains this
+		double min_time_ms = 100;  // Minimum duration of one sample
+		int samples = 5;
+		bool list = false;         // Print the case names instead of running them
+	};
+
+	struct Result {
+		std::string name;
+		size_t size = 0;
+		uint64_t iterations = 0;   // Per sample
+		double ns_per_op = 0;      // Median over the samples
+		double min_ns_per_op = 0;
+		double bytes_per_sec = 0;  // 0 when the case has no input bytes
+	};
+
+	inline uint64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline std::string json_escape(std::string_view text)
+	{
+		std::string out;
+		for (char c : text) {
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	inline void print_json(const Result& result)
+	{
+		printf("{\"name\":\"%s\",\"size\":%zu,\"iterations\":%llu,\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f,\"bytes_per_sec\":%.0f}\n",
+			json_escape(result.name).c_str(), result.size, (unsigned long long)result.iterations,
+			result.ns_per_op, result.min_ns_per_op, result.bytes_per_sec);
+		fflush(stdout);
+	}
+
+	/// <summary>
+	/// Parses --filter <text>, --min-time <ms>, --samples <n> and --list. Returns false on unknown arguments.
+	/// </summary>
+	inline bool parse_options(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--filter" && i + 1 < argc) options.filter = argv[++i];
+			else if (arg == "--min-time" && i + 1 < argc) options.min_time_ms = std::stod(argv[++i]);
+			else if (arg == "--samples" && i + 1 < argc) options.samples = std::max(1, std::stoi(argv[++i]));
+			else if (arg == "--list") options.list = true;
+			else return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Runs body repeatedly and prints the result. bytes is the input size processed by one call.
+	/// </summary>
+	inline void run(const Options& options, const std::string& name, size_t size, size_t bytes, const std::function<void()>& body)
+	{
+		if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+		if (options.list) {
+			printf("%s/%zu\n", name.c_str(), size);
+			return;
+		}
+
+		try {
+			body();
+		}
+		catch (const std::exception& e) {
+			printf("{\"name\":\"%s\",\"size\":%zu,\"error\":\"%s\"}\n", json_escape(name).c_str(), size, json_escape(e.what()).c_str());
+			fflush(stdout);
+			return;
+		}
+
+		// Calibrate: grow the iteration count until one sample takes min_time
+		uint64_t iterations = 1;
+		const uint64_t min_ns = static_cast<uint64_t>(options.min_time_ms * 1e6);
+		for (;;) {
+			auto start = now_ns();
+			for (uint64_t i = 0; i < iterations; ++i) body();
+			auto elapsed = now_ns() - start;
+			if (elapsed >= min_ns || iterations >= (1ull << 40)) break;
+			// Jump close to the target once the timing is meaningful
+			iterations = elapsed > min_ns / 100
+				? std::max(iterations * 2, static_cast<uint64_t>(iterations * 1.2 * min_ns / elapsed))
+				: iterations * 10;
+		}
+
+		std::vector<double> per_op;
+		for (int s = 0; s < options.samples; ++s) {
+			auto start = now_ns();
+			for (uint64_t i = 0; i < iterations; ++i) body();
+			per_op.push_back(double(now_ns() - start) / iterations);
+		}
+		std::sort(per_op.begin(), per_op.end());
+
+		Result result;
+		result.name = name;
+		result.size = size;
+		result.iterations = iterations;
+		result.ns_per_op = per_op[per_op.size() / 2];
+		result.min_ns_per_op = per_op.front();
+		result.bytes_per_sec = bytes && result.ns_per_op > 0 ? bytes * 1e9 / result.ns_per_op : 0;
+		print_json(result);
+	}
+}
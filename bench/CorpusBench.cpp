@@ -0,0 +1,468 @@
+// Synthetic site generator and end-to-end performance regression gate.
+//
+// Build on Linux from the repository root:
+//   g++ -std=c++20 -O2 -Ixtml -Ibench bench/CorpusBench.cpp $(ls xtml/*.cpp | grep -Ev 'xtml/(xtml|AllocHooks)\.cpp') -o xtml-corpusbench -lpthread
+//
+// Usage:
+//   xtml-corpusbench generate <dir> [--pages n] [--depth n] [--fanout n] [--blocks n] [--loop n] [--placeholders n] [--array n] [--seed n]
+//   xtml-corpusbench run <dir> [--repeat n] [--out <result.json>]
+//   xtml-corpusbench compare <baseline.json> <result.json> [--threshold <percent>] [--latency-threshold <percent>] [--rss-threshold <percent>]
+//
+// run builds every page of a generated site in-process, repeat times, and writes
+// throughput, latency percentiles and peak RSS as JSON. compare exits with 1 when
+// the result is significantly slower than the baseline.
+
+#include "Bench.h"
+#include "Globals.h"
+#include "Core.h"
+#include "Json.h"
+#include "Logger.h"
+#include "ModuleStd.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+FunctionRegistry g_functionRegistry;
+
+namespace {
+	struct CorpusOptions {
+		size_t pages = 50;
+		size_t depth = 2;          // Levels of nested includes below each page
+		size_t fanout = 2;         // Includes per page and per partial
+		size_t blocks = 4;         // <xtml> blocks per page
+		size_t loop = 20;          // Iterations of the numeric loop per block
+		size_t placeholders = 20;  // Placeholders in the page body
+		size_t array = 10;         // Elements of the array literal per page
+		unsigned seed = 1;
+	};
+
+	struct RunResult {
+		size_t pages = 0;
+		size_t repeat = 0;
+		size_t output_bytes = 0;             // Per repeat
+		vector<double> throughput;           // Pages per second, one sample per repeat
+		double p50_ms = 0, p90_ms = 0, p99_ms = 0, max_ms = 0;
+		long peak_rss_kb = 0;
+		string corpus;                       // Generation parameters, see corpus.json
+	};
+
+	bool parse_size(const string& text, size_t& value)
+	{
+		if (!Utils::is_number(text)) return false;
+		value = stoull(text);
+		return true;
+	}
+
+	void write_text(const fs::path& path, const string& content)
+	{
+		ofstream out(path, ios::binary);
+		if (!out) Utils::throw_err("Could not create file: " + path.string());
+		out << content;
+	}
+
+	string read_text(const fs::path& path)
+	{
+		ifstream in(path, ios::binary);
+		if (!in) Utils::throw_err("Could not open file: " + path.string());
+		stringstream buffer;
+		buffer << in.rdbuf();
+		return buffer.str();
+	}
+
+	string corpus_json(const CorpusOptions& o)
+	{
+		return "{\"pages\":" + to_string(o.pages) + ",\"depth\":" + to_string(o.depth) + ",\"fanout\":" + to_string(o.fanout) +
+			",\"blocks\":" + to_string(o.blocks) + ",\"loop\":" + to_string(o.loop) + ",\"placeholders\":" + to_string(o.placeholders) +
+			",\"array\":" + to_string(o.array) + ",\"seed\":" + to_string(o.seed) + "}";
+	}
+
+	string partial_name(size_t level, size_t index)
+	{
+		return "p" + to_string(level) + "_" + to_string(index) + ".xtml";
+	}
+
+	/// <summary>
+	/// A partial sets a few variables, runs a small loop and includes the partials of the next level
+	/// </summary>
+	string generate_partial(const CorpusOptions& o, size_t level, size_t index, mt19937& rng)
+	{
+		string content = "<xtml>\n";
+		content += "\t@var label" + to_string(level) + " = \"Partial " + to_string(level) + "." + to_string(index) + "\";\n";
+		content += "\t@var part_sum = 0;\n";
+		content += "\t@foreach (k in std::range(" + to_string(1 + rng() % (o.loop + 1)) + ")) { @var part_sum = part_sum + k; }\n";
+		content += "</xtml>\n";
+		content += "<section class=\"level-" + to_string(level) + "\">\n";
+		content += "\t<h3>{{@label" + to_string(level) + "}} ({{@part_sum}})</h3>\n";
+		if (level < o.depth) {
+			for (size_t f = 0; f < o.fanout; ++f) {
+				content += "\t<xtml include=\"" + partial_name(level + 1, f) + "\" param-parent=\"" + to_string(index) + "\" />\n";
+			}
+		}
+		content += "</section>\n";
+		return content;
+	}
+
+	string generate_page(const CorpusOptions& o, size_t page, mt19937& rng)
+	{
+		static const char* words[] = { "alpha", "beta", "gamma", "delta", "omega", "sigma", "kappa", "lambda" };
+		auto word = [&] { return string(words[rng() % 8]); };
+
+		string content = "<xtml>\n";
+		content += "\t@var title = \"Page " + to_string(page) + " " + word() + "\";\n";
+		content += "\t@var items = [";
+		for (size_t i = 0; i < o.array; ++i) {
+			content += (i ? ", \"" : "\"") + word() + to_string(i) + "\"";
+		}
+		content += "];\n";
+		content += "\t@var n = std::count(items);\n";
+		content += "\t@var list = \"\";\n";
+		content += "\t@foreach (item in items) { @var list = list + \"<li>\" + std::toUpper(item) + \"</li>\"; }\n";
+		content += "</xtml>\n";
+
+		for (size_t b = 0; b < o.blocks; ++b) {
+			auto id = to_string(b);
+			content += "<xtml>\n";
+			content += "\t@var total" + id + " = 0;\n";
+			content += "\t@foreach (k in std::range(" + to_string(o.loop) + ")) { @var total" + id + " = total" + id + " + k; }\n";
+			content += "\t@if (n > " + to_string(rng() % (o.array + 1)) + ") { @var state" + id + " = \"large\"; } @else { @var state" + id + " = \"small\"; }\n";
+			content += "</xtml>\n";
+		}
+
+		content += "<html>\n<head><title>{{@title}}</title></head>\n<body>\n";
+		content += "<ul>{{@list}}</ul>\n";
+		for (size_t f = 0; f < o.fanout && o.depth > 0; ++f) {
+			content += "<xtml include=\"partials/" + partial_name(1, f) + "\" />\n";
+		}
+		for (size_t p = 0; p < o.placeholders; ++p) {
+			content += "<p>" + word() + " ";
+			if (o.blocks > 0 && p % 2 == 1) {
+				auto id = to_string(rng() % o.blocks);
+				content += "{{@total" + id + "}} {{@state" + id + "}}";
+			}
+			else {
+				content += "{{@title|html}}";
+			}
+			content += "</p>\n";
+		}
+		content += "</body>\n</html>\n";
+		return content;
+	}
+
+	int action_generate(const fs::path& dir, const CorpusOptions& o)
+	{
+		mt19937 rng(o.seed);
+		fs::create_directories(dir / "partials");
+		for (size_t level = 1; level <= o.depth; ++level) {
+			for (size_t f = 0; f < o.fanout; ++f) {
+				write_text(dir / "partials" / partial_name(level, f), generate_partial(o, level, f, rng));
+			}
+		}
+		for (size_t page = 0; page < o.pages; ++page) {
+			write_text(dir / ("page" + to_string(page) + ".xtml"), generate_page(o, page, rng));
+		}
+		write_text(dir / "corpus.json", corpus_json(o) + "\n");
+		Utils::print_ln("Generated " + to_string(o.pages) + " pages in " + dir.string());
+		return 0;
+	}
+
+	long peak_rss_kb()
+	{
+#ifndef _WIN32
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss; // Kilobytes on Linux
+#endif
+		return 0;
+	}
+
+	double percentile(vector<double>& sorted, double p)
+	{
+		if (sorted.empty()) return 0;
+		auto index = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+		return sorted[std::min(index, sorted.size() - 1)];
+	}
+
+	string result_json(const RunResult& r)
+	{
+		char line[512];
+		string json = "{\n";
+		json += "\t\"corpus\": " + (r.corpus.empty() ? string("null") : r.corpus) + ",\n";
+		snprintf(line, sizeof(line), "\t\"pages\": %zu,\n\t\"repeat\": %zu,\n\t\"output_bytes\": %zu,\n", r.pages, r.repeat, r.output_bytes);
+		json += line;
+		json += "\t\"throughput_pages_per_sec\": [";
+		for (size_t i = 0; i < r.throughput.size(); ++i) {
+			snprintf(line, sizeof(line), "%s%.3f", i ? ", " : "", r.throughput[i]);
+			json += line;
+		}
+		json += "],\n";
+		snprintf(line, sizeof(line), "\t\"latency_ms\": { \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n\t\"peak_rss_kb\": %ld\n}\n",
+			r.p50_ms, r.p90_ms, r.p99_ms, r.max_ms, r.peak_rss_kb);
+		json += line;
+		return json;
+	}
+
+	int action_run(const fs::path& dir, size_t repeat, const string& out_path)
+	{
+		vector<string> pages;
+		for (auto& entry : fs::directory_iterator(dir)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".xtml") {
+				pages.push_back(entry.path().string());
+			}
+		}
+		sort(pages.begin(), pages.end());
+		if (pages.empty()) {
+			Utils::printerr_ln("Error: No .xtml pages in " + dir.string());
+			return 1;
+		}
+
+		RunResult result;
+		result.pages = pages.size();
+		result.repeat = repeat;
+		if (fs::exists(dir / "corpus.json")) {
+			result.corpus = Utils::trim(read_text(dir / "corpus.json"));
+		}
+
+		// Build messages would dominate the timings
+		auto level = Logger::level();
+		Logger::set_level(LL_ERROR);
+
+		vector<double> latencies;
+		latencies.reserve(pages.size() * repeat);
+		// One untimed pass warms the page cache and the allocator
+		for (size_t r = 0; r <= repeat; ++r) {
+			size_t bytes = 0;
+			auto start = bench::now_ns();
+			for (auto& page : pages) {
+				auto page_start = bench::now_ns();
+				VarMap vars;
+				auto output = Core::build_file(page, vars);
+				bench::do_not_optimize(output);
+				bytes += output.size();
+				if (r > 0) latencies.push_back((bench::now_ns() - page_start) / 1e6);
+			}
+			auto elapsed = bench::now_ns() - start;
+			if (r > 0) {
+				result.throughput.push_back(pages.size() * 1e9 / elapsed);
+				result.output_bytes = bytes;
+			}
+		}
+		Logger::set_level(level);
+
+		sort(latencies.begin(), latencies.end());
+		result.p50_ms = percentile(latencies, 0.50);
+		result.p90_ms = percentile(latencies, 0.90);
+		result.p99_ms = percentile(latencies, 0.99);
+		result.max_ms = latencies.back();
+		result.peak_rss_kb = peak_rss_kb();
+
+		auto json = result_json(result);
+		if (out_path.empty()) {
+			printf("%s", json.c_str());
+		}
+		else {
+			write_text(out_path, json);
+			Utils::print_ln("Result written to " + out_path);
+		}
+		return 0;
+	}
+
+	bool load_result(const string& path, RunResult& result)
+	{
+		auto root = Json::parse(read_text(path));
+		if (root.type != DT_OBJECT || !root.object) {
+			Utils::printerr_ln("Error: Not a result file: " + path);
+			return false;
+		}
+		auto number = [&](string_view name) -> double {
+			auto field = root.object->field(name);
+			return field ? stod(field->value) : 0;
+		};
+		result.pages = static_cast<size_t>(number("pages"));
+		result.repeat = static_cast<size_t>(number("repeat"));
+		result.peak_rss_kb = static_cast<long>(number("peak_rss_kb"));
+		if (auto samples = root.object->field("throughput_pages_per_sec"); samples && samples->type == DT_ARRAY) {
+			for (size_t i = 0; i < samples->array.size(); ++i) {
+				result.throughput.push_back(stod(samples->array.at(i).value));
+			}
+		}
+		if (auto latency = root.object->field("latency_ms"); latency && latency->object) {
+			auto get = [&](string_view name) { auto f = latency->object->field(name); return f ? stod(f->value) : 0.0; };
+			result.p50_ms = get("p50");
+			result.p90_ms = get("p90");
+			result.p99_ms = get("p99");
+			result.max_ms = get("max");
+		}
+		if (auto corpus = root.object->field("corpus"); corpus && corpus->object) {
+			// Only used to check that both runs used the same corpus
+			for (auto& [name, value] : corpus->object->fields) result.corpus += name + "=" + value.value + ";";
+		}
+		if (result.throughput.empty()) {
+			Utils::printerr_ln("Error: No throughput samples in " + path);
+			return false;
+		}
+		return true;
+	}
+
+	void mean_variance(const vector<double>& samples, double& mean, double& variance)
+	{
+		mean = 0;
+		for (double s : samples) mean += s;
+		mean /= samples.size();
+		variance = 0;
+		for (double s : samples) variance += (s - mean) * (s - mean);
+		variance = samples.size() > 1 ? variance / (samples.size() - 1) : 0;
+	}
+
+	// Two-sided 95% critical value of Student's t distribution
+	double t_critical(double df)
+	{
+		static const double table[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+		if (df < 1) return table[0];
+		if (df > 30) return 1.96;
+		return table[static_cast<size_t>(df) - 1];
+	}
+
+	struct CompareOptions {
+		double threshold = 5;           // Percent, throughput
+		double latency_threshold = 10;  // Percent, single valued metrics are noisier
+		double rss_threshold = 10;      // Percent, differences below 1 MB are ignored
+	};
+
+	int action_compare(const string& baseline_path, const string& current_path, const CompareOptions& options)
+	{
+		RunResult baseline, current;
+		if (!load_result(baseline_path, baseline) || !load_result(current_path, current)) {
+			return 1;
+		}
+		if (baseline.corpus != current.corpus || baseline.pages != current.pages) {
+			Utils::printerr_ln("Warning: The results were measured on different corpora, the comparison is not meaningful.");
+		}
+
+		bool regressed = false;
+		char line[256];
+
+		// Throughput: Welch's t-test over the per-repeat samples, flagged only when the
+		// slowdown is both larger than the threshold and statistically significant
+		double base_mean, base_var, cur_mean, cur_var;
+		mean_variance(baseline.throughput, base_mean, base_var);
+		mean_variance(current.throughput, cur_mean, cur_var);
+		double base_se = base_var / baseline.throughput.size();
+		double cur_se = cur_var / current.throughput.size();
+		double change = (cur_mean - base_mean) / base_mean * 100;
+		double t = base_se + cur_se > 0 ? (cur_mean - base_mean) / sqrt(base_se + cur_se) : 0;
+		double df = base_se + cur_se > 0 && baseline.throughput.size() > 1 && current.throughput.size() > 1
+			? (base_se + cur_se) * (base_se + cur_se) / (base_se * base_se / (baseline.throughput.size() - 1) + cur_se * cur_se / (current.throughput.size() - 1))
+			: 1;
+		bool significant = std::abs(t) > t_critical(df);
+		bool slower = change < -options.threshold && significant;
+		regressed |= slower;
+		snprintf(line, sizeof(line), "%-22s %12.2f %12.2f %+8.2f%%  t=%.2f%s%s", "throughput pages/s", base_mean, cur_mean, change, t,
+			significant ? " significant" : "", slower ? "  REGRESSION" : "");
+		Utils::print_ln(line);
+
+		// Latency percentiles and memory have one value per run, so they are only checked against a threshold
+		auto check = [&](const char* name, double before, double after, double threshold, double min_increase) {
+			double delta = before > 0 ? (after - before) / before * 100 : 0;
+			bool worse = delta > threshold && after - before > min_increase;
+			regressed |= worse;
+			snprintf(line, sizeof(line), "%-22s %12.3f %12.3f %+8.2f%%%s", name, before, after, delta, worse ? "  REGRESSION" : "");
+			Utils::print_ln(line);
+		};
+		check("latency p50 ms", baseline.p50_ms, current.p50_ms, options.latency_threshold, 0);
+		check("latency p90 ms", baseline.p90_ms, current.p90_ms, options.latency_threshold, 0);
+		check("latency p99 ms", baseline.p99_ms, current.p99_ms, options.latency_threshold, 0);
+		check("peak rss kb", double(baseline.peak_rss_kb), double(current.peak_rss_kb), options.rss_threshold, 1024);
+
+		Utils::print_ln(regressed ? "Result: regression" : "Result: ok");
+		return regressed ? 1 : 0;
+	}
+
+	void usage()
+	{
+		Utils::printerr_ln("Usage: xtml-corpusbench generate <dir> [--pages n] [--depth n] [--fanout n] [--blocks n] [--loop n] [--placeholders n] [--array n] [--seed n]");
+		Utils::printerr_ln("       xtml-corpusbench run <dir> [--repeat n] [--out <result.json>]");
+		Utils::printerr_ln("       xtml-corpusbench compare <baseline.json> <result.json> [--threshold <percent>] [--latency-threshold <percent>] [--rss-threshold <percent>]");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+
+	string command = argv[1];
+	try {
+		if (command == "generate") {
+			CorpusOptions o;
+			for (int i = 3; i < argc; ++i) {
+				string arg = argv[i];
+				size_t* target = arg == "--pages" ? &o.pages : arg == "--depth" ? &o.depth : arg == "--fanout" ? &o.fanout :
+					arg == "--blocks" ? &o.blocks : arg == "--loop" ? &o.loop : arg == "--placeholders" ? &o.placeholders :
+					arg == "--array" ? &o.array : nullptr;
+				size_t value;
+				if (i + 1 >= argc || !parse_size(argv[i + 1], value) || (!target && arg != "--seed")) {
+					usage();
+					return 1;
+				}
+				++i;
+				if (target) *target = value;
+				else o.seed = static_cast<unsigned>(value);
+			}
+			return action_generate(argv[2], o);
+		}
+		else if (command == "run") {
+			ModuleStd module;
+			module.RegisterFunctions(g_functionRegistry);
+			g_functionRegistry.Freeze();
+
+			size_t repeat = 10;
+			string out_path;
+			for (int i = 3; i < argc; ++i) {
+				string arg = argv[i];
+				if (arg == "--repeat" && i + 1 < argc && parse_size(argv[i + 1], repeat) && repeat > 0) ++i;
+				else if (arg == "--out" && i + 1 < argc) out_path = argv[++i];
+				else {
+					usage();
+					return 1;
+				}
+			}
+			return action_run(argv[2], repeat, out_path);
+		}
+		else if (command == "compare" && argc >= 4) {
+			CompareOptions options;
+			for (int i = 4; i < argc; ++i) {
+				string arg = argv[i];
+				if (arg == "--threshold" && i + 1 < argc) options.threshold = stod(argv[++i]);
+				else if (arg == "--latency-threshold" && i + 1 < argc) options.latency_threshold = stod(argv[++i]);
+				else if (arg == "--rss-threshold" && i + 1 < argc) options.rss_threshold = stod(argv[++i]);
+				else {
+					usage();
+					return 1;
+				}
+			}
+			return action_compare(argv[2], argv[3], options);
+		}
+	}
+	catch (const exception& e) {
+		Utils::printerr_ln(string("Error: ") + e.what());
+		return 1;
+	}
+
+	usage();
+	return 1;
+}
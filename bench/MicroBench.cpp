@@ -0,0 +1,282 @@
+// Microbenchmarks for the parsing and evaluation primitives.
+//
+// Build on Linux from the repository root:
+//   g++ -std=c++20 -O2 -Ixtml -Ibench bench/MicroBench.cpp $(ls xtml/*.cpp | grep -Ev 'xtml/(xtml|AllocHooks)\.cpp') -o xtml-microbench -lpthread
+//
+// Usage: xtml-microbench [--filter <text>] [--min-time <ms>] [--samples <n>] [--list]
+// Prints one JSON object per case and input size (see Bench.h).
+
+#include "Bench.h"
+#include "Globals.h"
+#include "Core.h"
+#include "Vars.h"
+#include "Statements.h"
+#include "Utils.h"
+#include "ModuleStd.h"
+#include "RenderContext.h"
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+FunctionRegistry g_functionRegistry;
+
+namespace {
+	const size_t sizes[] = { 1, 16, 256, 4096 };
+
+	string repeat(const string& part, size_t count, const string& separator = "")
+	{
+		string result;
+		for (size_t i = 0; i < count; ++i) {
+			if (i) result += separator;
+			result += part;
+		}
+		return result;
+	}
+
+	// The std::regex implementations the scanner replaced, kept as the reference for the scanner.* cases
+	namespace reference {
+		vector<XtmlTag> find_xtml_tags(const string& content)
+		{
+			vector<XtmlTag> tags;
+			regex re(R"(<xtml\b([^>]*)\/>|<xtml\b([^>]*)>([\s\S]*?)<\/xtml>)");
+			for (auto it = sregex_iterator(content.begin(), content.end(), re); it != sregex_iterator(); ++it) {
+				smatch m = *it;
+				XtmlTag tag;
+				tag.full = m.str(0);
+				tag.offset = m.position(0);
+				if (m[1].matched) {
+					tag.head = string("<xtml") + m[1].str() + "/>";
+					tag.self_closing = true;
+				}
+				else {
+					tag.head = string("<xtml") + m[2].str() + ">";
+					tag.content = m[3].str();
+					tag.self_closing = false;
+				}
+				tag.attributes = Core::parse_xtml_attributes(tag.head);
+				tags.push_back(std::move(tag));
+			}
+			return tags;
+		}
+
+		string resolve_placeholders(const string& content, const VarMap& vars)
+		{
+			map<string, var> results;
+			regex re(R"(\{\{([^\}]+)\}\})");
+			for (auto it = sregex_iterator(content.begin(), content.end(), re); it != sregex_iterator(); ++it) {
+				auto inner = Utils::trim(it->str(1));
+				if (inner[0] == '@') {
+					results[it->str(0)] = Vars::eval_expr(inner.substr(1), vars);
+				}
+			}
+			string result = content;
+			for (const auto& [placeholder, value] : results) {
+				result = Utils::replace(result, placeholder, value.value);
+			}
+			return result;
+		}
+
+		vector<string> find_unresolved_vars(const string& content)
+		{
+			vector<string> unresolved;
+			regex re(R"(\{\{@([a-zA-Z0-9_]+)\}\})");
+			for (auto it = sregex_iterator(content.begin(), content.end(), re); it != sregex_iterator(); ++it) {
+				unresolved.push_back(it->str(1));
+			}
+			return unresolved;
+		}
+	}
+
+	void bench_core(const bench::Options& options)
+	{
+		for (size_t n : sizes) {
+			string content;
+			for (size_t i = 0; i < n; ++i) {
+				content += "<p>Paragraph " + to_string(i) + " with some text around it.</p>\n";
+				content += "<xtml>@var v" + to_string(i) + " = " + to_string(i) + ";</xtml>\n";
+				content += "<xtml include=\"part.xtml\" title=\"Item " + to_string(i) + "\" />\n";
+			}
+			bench::run(options, "scanner.find_xtml_tags", n, content.size(), [&] {
+				bench::do_not_optimize(Core::find_xtml_tags(content));
+			});
+			bench::run(options, "regex.find_xtml_tags", n, content.size(), [&] {
+				bench::do_not_optimize(reference::find_xtml_tags(content));
+			});
+		}
+
+		for (size_t n : sizes) {
+			string code;
+			for (size_t i = 0; i < n; ++i) {
+				code += "@var v" + to_string(i) + " = \"a;b\" + " + to_string(i) + ";\n";
+				code += "@if (v" + to_string(i) + " == 1) { @var w = 2; }\n";
+			}
+			bench::run(options, "core.split_statements", n, code.size(), [&] {
+				bench::do_not_optimize(Core::split_statements(code));
+			});
+		}
+
+		for (size_t n : sizes) {
+			VarMap vars;
+			string content;
+			for (size_t i = 0; i < n; ++i) {
+				vars["name" + to_string(i)] = var{ "value " + to_string(i), DT_STRING };
+				content += "<li>{{@name" + to_string(i) + "}}</li>";
+			}
+			bench::run(options, "scanner.resolve_placeholders", n, content.size(), [&] {
+				bench::do_not_optimize(Core::resolve_placeholders(content, vars));
+			});
+			bench::run(options, "regex.resolve_placeholders", n, content.size(), [&] {
+				bench::do_not_optimize(reference::resolve_placeholders(content, vars));
+			});
+			bench::run(options, "core.resolve_placeholders_html", n, content.size(), [&] {
+				bench::do_not_optimize(Core::resolve_placeholders(content, vars, ESC_HTML));
+			});
+		}
+
+		for (size_t n : sizes) {
+			// Finished page text with one placeholder left in every paragraph
+			string content;
+			for (size_t i = 0; i < n; ++i) {
+				content += "<p>Paragraph " + to_string(i) + " {with} braces {{@missing" + to_string(i) + "}} and text.</p>\n";
+			}
+			bench::run(options, "scanner.find_unresolved_vars", n, content.size(), [&] {
+				bench::do_not_optimize(Core::find_unresolved_vars(content));
+			});
+			bench::run(options, "regex.find_unresolved_vars", n, content.size(), [&] {
+				bench::do_not_optimize(reference::find_unresolved_vars(content));
+			});
+		}
+	}
+
+	void bench_eval(const bench::Options& options)
+	{
+		VarMap vars;
+		vars["name"] = var{ "World", DT_STRING };
+		vars["count"] = var{ "42", DT_NUMBER };
+
+		for (size_t n : sizes) {
+			// Literal: one quoted string of n characters
+			auto literal = "\"" + string(n, 'x') + "\"";
+			bench::run(options, "eval_expr.literal", n, literal.size(), [&] {
+				bench::do_not_optimize(Vars::eval_expr(literal, vars));
+			});
+
+			// Arithmetic: a variable plus n numeric terms
+			auto arithmetic = "count + " + repeat("3", n, " + ");
+			bench::run(options, "eval_expr.arithmetic", n, arithmetic.size(), [&] {
+				bench::do_not_optimize(Vars::eval_expr(arithmetic, vars));
+			});
+
+			// Concatenation: n string and variable operands
+			auto concat = "\"<li>\" + " + repeat("name + \", \"", n, " + ");
+			bench::run(options, "eval_expr.concat", n, concat.size(), [&] {
+				bench::do_not_optimize(Vars::eval_expr(concat, vars));
+			});
+
+			// Function call with an argument of n characters
+			auto call = "std::toUpper(\"" + string(n, 'a') + "\")";
+			bench::run(options, "eval_expr.function_call", n, call.size(), [&] {
+				bench::do_not_optimize(Vars::eval_expr(call, vars));
+			});
+
+			// Array literal with n elements
+			auto array = "[" + repeat("\"item\", count", n, ", ") + "]";
+			bench::run(options, "eval_expr.array", n, array.size(), [&] {
+				bench::do_not_optimize(Vars::eval_expr(array, vars));
+			});
+
+			// Condition with n clauses joined by &&
+			auto condition = repeat("count > 1", n, " && ");
+			bench::run(options, "statements.evaluate_condition", n, condition.size(), [&] {
+				bench::do_not_optimize(Statements::evaluate_condition(condition, "", vars));
+			});
+		}
+	}
+
+	void bench_utils(const bench::Options& options)
+	{
+		for (size_t n : sizes) {
+			auto text = repeat("lorem {{name}} ipsum ", n);
+			bench::run(options, "utils.replace", n, text.size(), [&] {
+				bench::do_not_optimize(Utils::replace(text, "{{name}}", "World"));
+			});
+
+			auto padded = string(n, ' ') + "content" + string(n, '\n');
+			bench::run(options, "utils.trim", n, padded.size(), [&] {
+				bench::do_not_optimize(Utils::trim(padded));
+			});
+		}
+	}
+
+	void bench_builtin(const bench::Options& options, const string& function, size_t n, const vector<var>& args, size_t bytes)
+	{
+		auto func = g_functionRegistry.FindFunction("std", function);
+		bench::run(options, "std::" + function, n, bytes, [&] {
+			bench::do_not_optimize(func->callback(args));
+		});
+	}
+
+	void bench_builtins(const bench::Options& options)
+	{
+		for (size_t n : sizes) {
+			string text(n, 'a');
+			var str{ text, DT_STRING };
+			var quoted{ "\"" + text + "\"", DT_STRING };
+			var padded{ "  " + text + "  ", DT_STRING };
+			var number{ to_string(n), DT_NUMBER };
+			var numeric_str{ string(min<size_t>(n, 9), '7'), DT_STRING };
+
+			var array{ "", DT_ARRAY };
+			for (size_t i = 0; i < n; ++i) {
+				array.array.push_back(var{ to_string(i), DT_NUMBER });
+			}
+			var middle{ to_string(n / 2), DT_NUMBER };
+			var zero{ "0", DT_NUMBER };
+
+			bench_builtin(options, "toUpper", n, { str }, text.size());
+			bench_builtin(options, "toLower", n, { str }, text.size());
+			bench_builtin(options, "randStr", n, { number }, 0);
+			bench_builtin(options, "isInt", n, { numeric_str }, numeric_str.value.size());
+			bench_builtin(options, "isStr", n, { str }, text.size());
+			bench_builtin(options, "toInt", n, { numeric_str }, numeric_str.value.size());
+			bench_builtin(options, "toStr", n, { number }, 0);
+			bench_builtin(options, "len", n, { str }, text.size());
+			bench_builtin(options, "trim", n, { padded }, padded.value.size());
+			bench_builtin(options, "trimQuotes", n, { quoted }, quoted.value.size());
+			bench_builtin(options, "get", n, { array, middle }, 0);
+			bench_builtin(options, "count", n, { array }, 0);
+			bench_builtin(options, "range", n, { zero, number }, 0);
+			bench_builtin(options, "slice", n, { array, zero, middle }, 0);
+			bench_builtin(options, "print", n, { str }, text.size());
+			bench_builtin(options, "uuid", n, {}, 0);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bench::Options options;
+	if (!bench::parse_options(argc, argv, options)) {
+		Utils::printerr_ln("Usage: xtml-microbench [--filter <text>] [--min-time <ms>] [--samples <n>] [--list]");
+		return 1;
+	}
+
+	ModuleStd module;
+	module.RegisterFunctions(g_functionRegistry);
+	g_functionRegistry.Freeze();
+
+	// Messages logged by the code under test would distort the timings
+	LogFunc silent = [](LogLevel, const string&) {};
+	RenderContext context;
+	context.log = &silent;
+	RenderScope scope(context);
+
+	bench_core(options);
+	bench_eval(options);
+	bench_utils(options);
+	bench_builtins(options);
+	return 0;
+}
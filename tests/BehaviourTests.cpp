@@ -0,0 +1,619 @@
+// Behaviour checks for the engine building blocks: data structures, scanners,
+// loaders and render limits. Each case compares observable results, not timings.
+//
+// Build and run on Linux from the repository root:
+//   g++ -std=c++20 -O2 -Ixtml tests/BehaviourTests.cpp $(ls xtml/*.cpp | grep -Ev 'xtml/(xtml|AllocHooks)\.cpp') -o xtml-tests -lpthread
+//   ./xtml-tests [--filter <text>] [--list]
+// Prints every failed check and exits with 1 if there was one.
+
+#include "Globals.h"
+#include "Engine.h"
+#include "Core.h"
+#include "Vars.h"
+#include "Escaper.h"
+#include "Iterable.h"
+#include "Csv.h"
+#include "Json.h"
+#include "Minifier.h"
+#include "Utils.h"
+#include "ModuleStd.h"
+#include "RenderContext.h"
+#include "Scanner.h"
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+FunctionRegistry g_functionRegistry;
+
+namespace {
+	size_t g_checks = 0;
+	size_t g_failures = 0;
+	const char* g_case = "";
+	fs::path g_temp_dir;
+
+	void check(bool condition, const string& what)
+	{
+		++g_checks;
+		if (!condition) {
+			++g_failures;
+			fprintf(stderr, "FAIL %s: %s\n", g_case, what.c_str());
+		}
+	}
+
+	void check_equal(const string& actual, const string& expected, const string& what)
+	{
+		check(actual == expected, what + ": expected \"" + expected + "\", got \"" + actual + "\"");
+	}
+
+	// Message of the exception thrown by fn, empty if it returned normally
+	string error_of(const function<void()>& fn)
+	{
+		try {
+			fn();
+		}
+		catch (const exception& e) {
+			return e.what();
+		}
+		return "";
+	}
+
+	// Writes content to a file in the temporary test folder and returns its path
+	string write_temp(const string& name, const string& content)
+	{
+		auto path = (g_temp_dir / name).string();
+		ofstream out(path, ios::binary);
+		out << content;
+		return path;
+	}
+
+	var number(int64_t value)
+	{
+		return var{ to_string(value), DT_NUMBER };
+	}
+
+	var text(const string& value)
+	{
+		return var{ value, DT_STRING };
+	}
+
+	void test_array_copy_on_write()
+	{
+		var original{ "", DT_ARRAY };
+		for (int i = 0; i < 3; ++i) original.array.push_back(number(i));
+
+		// A copy shares the buffer until one side is modified
+		var copy = original;
+		copy.array.push_back(number(3));
+		check(original.array.size() == 3, "appending to a copy leaves the original alone");
+		check(copy.array.size() == 4, "the copy sees its own append");
+
+		original.array.push_back(text("x"));
+		check(copy.array.size() == 4, "appending to the original leaves the copy alone");
+		check_equal(copy.array.at(3).value, "3", "copy keeps its element");
+		check_equal(original.array.at(3).value, "x", "original keeps its element");
+
+		// An iterator holds its own reference, reassigning the collection mid-loop is safe
+		ArrayIterator it(original.array);
+		original.array = VarArray();
+		var item;
+		size_t seen = 0;
+		while (it.next(item)) ++seen;
+		check(seen == 4, "iterator still walks the array it was created from");
+	}
+
+	void test_array_columns()
+	{
+		var numbers{ "", DT_ARRAY };
+		for (int i = 0; i < 5; ++i) numbers.array.push_back(number(i * 10));
+		check(numbers.array.at(4).type == DT_NUMBER, "number column boxes DT_NUMBER");
+		check_equal(numbers.array.at(4).value, "40", "number column value");
+
+		var strings{ "", DT_ARRAY };
+		strings.array.push_back(text("a"));
+		strings.array.push_back(text(""));
+		strings.array.push_back(text("ccc"));
+		check_equal(strings.array.at(1).value, "", "empty string in a string column");
+		check_equal(strings.array.at(2).value, "ccc", "string column value");
+
+		// A value of another type turns the array back into boxed values
+		var mixed = numbers;
+		mixed.array.push_back(text("x"));
+		check(mixed.array.at(0).type == DT_NUMBER && mixed.array.at(5).type == DT_STRING, "mixed array keeps each element type");
+		check(numbers.array.size() == 5, "converting a copy leaves the column alone");
+
+		// Loading into a var that held an object or iterable clears them
+		var target{ "", DT_OBJECT };
+		target.object = make_shared<VarObject>();
+		target.iterable = make_shared<RangeIterable>(0, 3, 1);
+		numbers.array.load(1, target);
+		check(target.type == DT_NUMBER && !target.object && !target.iterable, "load resets object and iterable");
+		strings.array.load(0, target);
+		check(target.type == DT_STRING && target.array.empty(), "load of a string column entry");
+
+		check(!error_of([&] { numbers.array.at(5); }).empty(), "index past the end throws");
+	}
+
+	// Random text over a small alphabet, so searched bytes appear at every offset and
+	// vector width, including bytes above 0x7F that break signed comparisons
+	string random_text(mt19937& rng, size_t size)
+	{
+		static const char alphabet[] = "ab<{}\"\\,\n\x80\xff";
+		string result(size, ' ');
+		for (auto& c : result) {
+			c = rng() % 4 == 0 ? alphabet[rng() % (sizeof(alphabet) - 1)] : 'a' + rng() % 26;
+		}
+		return result;
+	}
+
+	void test_scanner_matches_reference()
+	{
+		mt19937 rng(32);
+		size_t mismatches = 0;
+		for (size_t round = 0; round < 4000; ++round) {
+			auto data = random_text(rng, rng() % 300);
+			// Search a view that does not start at the beginning of the buffer, to vary alignment
+			size_t skip = data.empty() ? 0 : rng() % 8 % (data.size() + 1);
+			string_view text = string_view(data).substr(skip);
+			size_t pos = rng() % (text.size() + 2);
+
+			if (Scanner::find_either(text, '<', '{', pos) != text.find_first_of("<{", pos)) ++mismatches;
+			if (Scanner::find_markup(text, pos) != text.find_first_of("<{", pos)) ++mismatches;
+			if (Scanner::find_either(text, '\x80', '\n', pos) != text.find_first_of("\x80\n", pos)) ++mismatches;
+			string_view set = "\"{}[],\xff";
+			if (Scanner::find_first_of(text, set, pos) != text.find_first_of(set, pos)) ++mismatches;
+			for (string_view needle : { "<x", "ab", "{{@", "\xff\x80", "a" }) {
+				if (Scanner::find(text, needle, pos) != text.find(needle, pos)) ++mismatches;
+			}
+		}
+		check(mismatches == 0, string("scanner (") + Scanner::implementation() + ") agrees with string_view searches, " + to_string(mismatches) + " mismatches");
+	}
+
+	// Character by character escaping, the behaviour the scanner based Escaper must reproduce
+	string escape_reference(string_view value, EscapeMode mode)
+	{
+		string out;
+		for (char c : value) {
+			switch (c) {
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			case '\'': out += "&#39;"; break;
+			case '`': out += mode == ESC_ATTRIBUTE ? "&#96;" : "`"; break;
+			case '=': out += mode == ESC_ATTRIBUTE ? "&#61;" : "="; break;
+			default: out += c;
+			}
+		}
+		return out;
+	}
+
+	void test_escaper_matches_reference()
+	{
+		mt19937 rng(34);
+		size_t mismatches = 0;
+		for (size_t round = 0; round < 2000; ++round) {
+			string value(rng() % 200, ' ');
+			for (auto& c : value) {
+				c = rng() % 5 == 0 ? "&<>\"'`=\x80"[rng() % 8] : 'a' + rng() % 26;
+			}
+			for (auto mode : { ESC_HTML, ESC_ATTRIBUTE }) {
+				if (Escaper::escape(value, mode) != escape_reference(value, mode)) ++mismatches;
+			}
+			if (Escaper::escape(value, ESC_RAW) != value) ++mismatches;
+		}
+		check(mismatches == 0, "escaper agrees with the character by character reference, " + to_string(mismatches) + " mismatches");
+
+		check_equal(Escaper::escape("a b/\xc3\xa9~", ESC_URL), "a%20b%2F%C3%A9~", "url escaping");
+		string out = "<p>";
+		Escaper::append(out, "1 < 2", ESC_HTML);
+		check_equal(out, "<p>1 &lt; 2", "append keeps what is already in the buffer");
+
+		EscapeMode mode;
+		check(Escaper::parse_mode("attr", mode) && mode == ESC_ATTRIBUTE, "parse_mode attr");
+		check(!Escaper::parse_mode("js", mode), "parse_mode rejects unknown names");
+	}
+
+	void test_minifier()
+	{
+		const string page = "  <div>\n   <!-- c -->  <!--[if IE]>x<![endif]-->\n @var x = 1;\n<pre>  a\n   b </pre>   <p>t   u</p>\n  \n</div>  ";
+		check_equal(Minifier::minify(page), "<div>\n<!-- c -->  <!--[if IE]>x<![endif]-->\n<pre>  a\nb </pre>   <p>t   u</p>\n\n</div>\n",
+			"default cleanup trims lines and drops @var lines");
+		check_equal(Minifier::minify(page, MinifyOptions::full()), "<div>\n<!--[if IE]>x<![endif]-->\n<pre>  a\n   b </pre> <p>t u</p>\n</div>",
+			"full minification collapses whitespace, strips comments and keeps <pre>");
+
+		// Streaming in chunks of any size gives the same output as one call
+		mt19937 rng(33);
+		size_t mismatches = 0;
+		for (auto& options : { MinifyOptions(), MinifyOptions::full() }) {
+			auto expected = Minifier::minify(page + page, options);
+			for (size_t round = 0; round < 200; ++round) {
+				string input = page + page;
+				Minifier minifier(options);
+				for (size_t pos = 0; pos < input.size();) {
+					size_t size = 1 + rng() % 12;
+					minifier.write(string_view(input).substr(pos, size));
+					pos += size;
+				}
+				if (minifier.finish() != expected) ++mismatches;
+			}
+		}
+		check(mismatches == 0, "chunked writes match a single minify call, " + to_string(mismatches) + " mismatches");
+	}
+
+	void test_batch_output_order()
+	{
+		xtml::Engine engine;
+		engine.set_logger([](LogLevel, const string&) {});
+		// Loop length varies per set so renders finish out of order; set 13 fails
+		auto tpl = engine.compile_string(
+			"<xtml>\n"
+			"@var s = 0;\n"
+			"@foreach (i in std::range(0, n)) { @var s = s + i; }\n"
+			"@if (n == 13) { @var y = std::get(std::range(0, 1), 5); }\n"
+			"</xtml>\n"
+			"<p>{{@n}}:{{@s}}</p>");
+
+		const size_t count = 300;
+		size_t next = 0;
+		auto source = [&](VarMap& vars) {
+			if (next == count) return false;
+			int64_t n = static_cast<int64_t>((next * 37) % 101);
+			vars["n"] = number(n);
+			++next;
+			return true;
+		};
+
+		vector<size_t> indices;
+		size_t wrong_output = 0;
+		xtml::BatchOptions options;
+		options.threads = 8;
+		options.max_pending = 16;
+		auto result = engine.render_batch(*tpl, source, [&](size_t index, const VarMap& vars, string_view output) {
+			int64_t n = stoll(vars.at("n").value);
+			if (output.find("<p>" + to_string(n) + ":" + to_string(n * (n - 1) / 2) + "</p>") == string_view::npos) ++wrong_output;
+			indices.push_back(index);
+		}, options);
+
+		// (index * 37) % 101 == 13 for the sets 14, 115 and 216
+		check(result.errors.size() == 3, "failed sets are reported, got " + to_string(result.errors.size()));
+		check(result.rendered == count - 3 && indices.size() == count - 3, "every other set is rendered");
+		bool ascending = true;
+		for (size_t i = 1; i < indices.size(); ++i) ascending = ascending && indices[i] > indices[i - 1];
+		check(ascending, "results reach the sink in input order");
+		check(wrong_output == 0, "each output belongs to its own variable set");
+		for (auto& [index, message] : result.errors) {
+			check((index * 37) % 101 == 13, "error reported for set " + to_string(index));
+		}
+	}
+
+	void test_batch_sink_errors()
+	{
+		xtml::Engine engine;
+		engine.set_logger([](LogLevel, const string&) {});
+		engine.registry().RegisterNamespace("out");
+		engine.registry().RegisterFunction("out", "dir", [](const vector<var>&) { return var{ "pages", DT_STRING }; });
+		auto tpl = engine.compile_string("<p>{{@n}}</p>");
+
+		const size_t count = 50;
+		size_t next = 0;
+		auto source = [&](VarMap& vars) {
+			if (next == count) return false;
+			vars["n"] = number(static_cast<int64_t>(next++));
+			return true;
+		};
+
+		vector<string> paths;
+		xtml::BatchOptions options;
+		options.threads = 4;
+		auto result = engine.render_batch(*tpl, source, [&](size_t index, const VarMap& vars, string_view) {
+			// out::dir is only registered with the engine, not in the process wide registry
+			paths.push_back(Core::resolve_placeholders("{{out::dir()}}/{{@n}}.html", vars));
+			if (index % 10 == 3) throw runtime_error("disk full");
+		}, options);
+
+		check(result.errors.size() == 5, "sink failures are reported, got " + to_string(result.errors.size()));
+		for (auto& [index, message] : result.errors) {
+			check(index % 10 == 3 && message == "disk full", "sink failure reported for set " + to_string(index) + ": " + message);
+		}
+		check(result.rendered == count - 5, "sets the sink accepted count as rendered");
+		check(paths.size() == count && paths[7] == "pages/7.html", "sink resolves engine functions");
+	}
+
+	// Elements of a collection, DT_ARRAY or DT_ITERABLE
+	vector<var> elements(const var& collection)
+	{
+		vector<var> items;
+		unique_ptr<VarIterator> it = collection.type == DT_ITERABLE ? collection.iterable->iterate() : make_unique<ArrayIterator>(collection.array);
+		var item;
+		while (it->next(item)) items.push_back(item);
+		return items;
+	}
+
+	void test_json_loader()
+	{
+		auto doc = Json::parse(R"({"s": "a\"b\u00e9\ud83d\ude00", "n": -12, "f": 1.5, "t": true, "z": null, "a": [1, "x", {"k": []}]})");
+		check(doc.type == DT_OBJECT && doc.object->size() == 6, "object with six fields");
+		check_equal(doc.object->field("s")->value, "a\"b\xc3\xa9\xf0\x9f\x98\x80", "string escapes and surrogate pairs");
+		check(doc.object->field("n")->type == DT_NUMBER && doc.object->field("f")->type == DT_STRING, "integers are numbers, other numbers text");
+		check(doc.object->field("t")->type == DT_BOOL && doc.object->field("z")->value.empty(), "true and null");
+		check(doc.object->field("a")->array.size() == 3, "nested array");
+
+		check(error_of([] { Json::parse("[1, 2] x"); }).find("unexpected data after value") != string::npos, "trailing data is rejected");
+		string deep = string(600, '[') + string(600, ']');
+		check(error_of([&] { Json::parse(deep); }).find("nesting deeper than") != string::npos, "deep nesting raises an error");
+		check(error_of([] { Json::parse(string(100, '[') + string(100, ']')); }).empty(), "moderate nesting parses");
+
+		// Top level arrays are read lazily, element boundaries must respect strings
+		auto array_path = write_temp("items.json", R"( [ {"t": "x,]}\"0"}, [1, [2]], "three" , 4 ] )");
+		auto items = Json::load_file(array_path);
+		check(items.type == DT_ITERABLE, "top level array is lazy");
+		auto list = elements(items);
+		check(list.size() == 4, "four array elements, got " + to_string(list.size()));
+		if (list.size() == 4) {
+			check_equal(list[0].object->field("t")->value, "x,]}\"0", "string with structural characters");
+			check(list[1].type == DT_ARRAY && list[1].array.size() == 2, "nested array element");
+			check_equal(list[2].value, "three", "string element");
+			check_equal(list[3].value, "4", "last element");
+		}
+		check_equal(g_functionRegistry.CallFunction("std", "count", { items }).value, "4", "std::count on a lazy array");
+		check_equal(g_functionRegistry.CallFunction("std", "get", { items, number(2) }).value, "three", "std::get on a lazy array");
+		check(!error_of([&] { g_functionRegistry.CallFunction("std", "get", { items, number(4) }); }).empty(), "std::get past the end throws");
+		check(elements(Json::load_file(write_temp("empty.json", "[ ]"))).empty(), "empty top level array");
+
+		auto lines = Json::load_file(write_temp("rows.jsonl", "{\"id\": 1}\n\n  \n{\"id\": 2}\n"));
+		check_equal(g_functionRegistry.CallFunction("std", "count", { lines }).value, "2", "JSON Lines skip blank lines");
+		check(Json::load_file(write_temp("doc.json", R"({"a": 1})")).type == DT_OBJECT, "whole document file");
+	}
+
+	void test_csv_loader()
+	{
+		auto path = write_temp("rows.csv",
+			"id, name,note\r\n"
+			"1,plain,\"a, b\"\r\n"
+			"\r\n"
+			"2,\"say \"\"hi\"\"\",\"two\nlines\"\n"
+			"3,short\n"
+			"0042x,last,end");
+		auto rows = Csv::load_file(path);
+		check(rows.type == DT_ITERABLE && rows.iterable->size() == 4, "row count is known up front and skips blank lines");
+		auto list = elements(rows);
+		check(list.size() == 4, "four rows, got " + to_string(list.size()));
+		if (list.size() != 4) return;
+
+		auto field = [&](size_t row, const string& name) {
+			auto value = list[row].object->field(name);
+			return value ? value->value : string("<missing>");
+		};
+		check_equal(field(0, "name"), "plain", "header names are trimmed");
+		check_equal(field(0, "note"), "a, b", "quoted comma");
+		check(list[0].object->field("id")->type == DT_NUMBER, "numeric field is a number");
+		check_equal(field(1, "name"), "say \"hi\"", "escaped quotes");
+		check_equal(field(1, "note"), "two\nlines", "newline inside quotes");
+		check_equal(field(2, "note"), "", "missing trailing field is empty");
+		check(list[3].object->field("id")->type == DT_STRING, "non-numeric field is text");
+		check_equal(field(3, "note"), "end", "last row without a line break");
+		check(list[0].object->field("other") == nullptr, "unknown column");
+	}
+
+	void test_budget_limits()
+	{
+		xtml::Engine engine;
+		engine.set_logger([](LogLevel, const string&) {});
+		auto loop = engine.compile_string(
+			"<xtml>\n"
+			"@var s = \"\";\n"
+			"@foreach (i in std::range(0, n)) { @var s = s + \"ab\"; }\n"
+			"</xtml>\n"
+			"{{@s}}");
+		VarMap small = { { "n", number(10) } };
+		VarMap large = { { "n", number(5000) } };
+		auto render_error = [&](const xtml::Template& tpl, const VarMap& vars) {
+			return error_of([&] { engine.render(tpl, vars); });
+		};
+
+		BudgetLimits limits;
+		limits.loop_iterations = 100;
+		engine.set_budget_limits(limits);
+		check(render_error(*loop, small).empty(), "a render within the limit succeeds");
+		check(render_error(*loop, large).find("more than 100 loop iterations") != string::npos, "loop iteration limit");
+		check(render_error(*loop, small).empty(), "the next render starts with a fresh budget");
+
+		limits = BudgetLimits();
+		limits.statements = 200;
+		engine.set_budget_limits(limits);
+		check(render_error(*loop, large).find("more than 200 statements") != string::npos, "statement limit");
+
+		limits = BudgetLimits();
+		limits.output_bytes = 1000;
+		engine.set_budget_limits(limits);
+		check(render_error(*loop, large).find("bytes of output") != string::npos, "output limit");
+
+		limits = BudgetLimits();
+		limits.wall_ms = 50;
+		engine.set_budget_limits(limits);
+		auto endless = engine.compile_string("<xtml>\n@var x = 0;\n@while (1 == 1) { @var x = x + 1; }\n</xtml>");
+		check(render_error(*endless, {}).find("ms wall time") != string::npos, "wall time limit stops an endless loop");
+
+		// A page including itself is stopped by the default include depth
+		engine.set_budget_limits(BudgetLimits());
+		auto self = write_temp("self.xtml", "x<xtml include=\"self.xtml\" />");
+		check(render_error(*engine.compile(self), {}).find("more than 64 nested includes") != string::npos, "include depth stops an include cycle");
+
+		check(Budget::set_option("--max-output", "4096", limits) && limits.output_bytes == 4096, "set_option parses a number");
+		check(!Budget::set_option("--max-output", "4k", limits), "set_option rejects other values");
+		check(!Budget::is_option("--max-files"), "unknown budget option");
+	}
+
+	// Registers ns::name returning value
+	void register_constant(FunctionRegistry& registry, const string& ns, const string& name, const string& value)
+	{
+		registry.RegisterNamespace(ns);
+		registry.RegisterFunction(ns, name, [value](const vector<var>&) { return var{ value, DT_STRING }; });
+	}
+
+	void test_registry_reload()
+	{
+		FunctionRegistry registry;
+		register_constant(registry, "t", "f", "old");
+		registry.Freeze();
+		check(!error_of([&] { register_constant(registry, "t", "g", ""); }).empty(), "registering after Freeze throws");
+
+		// An expression resolved when its node was built calls whatever the registry holds now
+		auto compiled = Vars::compile_expr("t::f() + \"-\" + t::g()");
+		RenderContext context = RenderContext::current();
+		context.registry = &registry;
+		auto eval_compiled = [&] {
+			RenderScope scope(context);
+			return Vars::eval_expr(compiled, {}).value;
+		};
+		check(error_of(eval_compiled).find("Function not found: t::g") != string::npos, "compiled call to a missing function");
+
+		auto old_ref = registry.FindFunctionRef("t", "f");
+		FunctionRegistry staged;
+		register_constant(staged, "t", "f", "new");
+		register_constant(staged, "t", "g", "added");
+		registry.Reload(staged);
+		check_equal(registry.CallFunction("t", "f", {}).value, "new", "reload replaces a function");
+		check(registry.Exists("t", "g"), "reload adds a function");
+		check(old_ref && old_ref->callback({}).value == "old", "a reference into the replaced snapshot stays valid");
+		check_equal(eval_compiled(), "new-added", "compiled calls find reloaded functions");
+
+		// Namespaces are loaded on first use, once, and merged into one that already exists
+		FunctionRegistry lazy;
+		register_constant(lazy, "t", "f", "base");
+		map<string, int> requests;
+		lazy.SetNamespaceLoader([&](string_view name, FunctionRegistry& target) {
+			requests[string(name)]++;
+			if (name == "t") {
+				register_constant(target, "t", "extra", "loaded");
+				register_constant(target, "t", "f", "shadowed");
+				return true;
+			}
+			if (name == "m") {
+				register_constant(target, "m", "h", "module");
+				return true;
+			}
+			return false;
+		});
+		lazy.Freeze();
+		check_equal(lazy.CallFunction("m", "h", {}).value, "module", "namespace loaded on first use");
+		check(!lazy.Exists("m", "missing") && !lazy.Exists("m", "other"), "unknown functions of a loaded namespace");
+		check(!lazy.Exists("none", "x") && !lazy.Exists("none", "y"), "unknown namespace");
+		check_equal(lazy.CallFunction("t", "extra", {}).value, "loaded", "functions merged into an existing namespace");
+		check_equal(lazy.CallFunction("t", "f", {}).value, "base", "registered functions win over loaded ones");
+		check(requests["m"] == 1 && requests["none"] == 1 && requests["t"] == 1, "the loader is asked once per namespace");
+
+		// Lookups racing with reloads always see a complete snapshot
+		atomic<bool> done{ false };
+		atomic<size_t> bad{ 0 };
+		vector<thread> readers;
+		for (int i = 0; i < 4; ++i) {
+			readers.emplace_back([&] {
+				while (!done.load()) {
+					FunctionRegistry::ReadScope read;
+					auto function = registry.FindFunction("t", "f");
+					auto value = function ? function->callback({}).value : string();
+					if (value != "new" && value != "again") ++bad;
+				}
+			});
+		}
+		for (int i = 0; i < 200; ++i) {
+			FunctionRegistry next;
+			register_constant(next, "t", "f", i % 2 ? "new" : "again");
+			registry.Reload(next);
+		}
+		done = true;
+		for (auto& reader : readers) reader.join();
+		check(bad == 0, "concurrent lookups during reloads, " + to_string(bad.load()) + " bad results");
+
+		// With no reader left, a replaced snapshot is freed by the next publish; references keep it alive
+		auto last_ref = registry.FindFunctionRef("t", "f");
+		FunctionRegistry last;
+		register_constant(last, "t", "f", "last");
+		registry.Reload(last);
+		check(last_ref.use_count() == 1, "the registry releases a snapshot no reader can see");
+		check(old_ref->callback({}).value == "old", "a reference outlives several reloads");
+	}
+
+	struct Case {
+		const char* name;
+		void (*run)();
+	};
+
+	const Case cases[] = {
+		{ "array.copy_on_write", test_array_copy_on_write },
+		{ "array.columns", test_array_columns },
+		{ "scanner.matches_reference", test_scanner_matches_reference },
+		{ "escaper.matches_reference", test_escaper_matches_reference },
+		{ "minifier", test_minifier },
+		{ "engine.batch_output_order", test_batch_output_order },
+		{ "engine.batch_sink_errors", test_batch_sink_errors },
+		{ "data.json", test_json_loader },
+		{ "data.csv", test_csv_loader },
+		{ "budget.limits", test_budget_limits },
+		{ "registry.reload", test_registry_reload },
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	string filter;
+	bool list = false;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		}
+		else if (arg == "--list") {
+			list = true;
+		}
+		else {
+			Utils::printerr_ln("Usage: xtml-tests [--filter <text>] [--list]");
+			return 1;
+		}
+	}
+
+	ModuleStd module;
+	module.RegisterFunctions(g_functionRegistry);
+	g_functionRegistry.Freeze();
+
+	// Expected errors are checked through their exceptions, not the log
+	LogFunc silent = [](LogLevel, const string&) {};
+	RenderContext context;
+	context.log = &silent;
+	RenderScope scope(context);
+
+	g_temp_dir = fs::temp_directory_path() / ("xtml-tests-" + to_string(random_device()()));
+	fs::create_directories(g_temp_dir);
+
+	size_t run = 0;
+	for (auto& test : cases) {
+		if (string(test.name).find(filter) == string::npos) continue;
+		if (list) {
+			printf("%s\n", test.name);
+			continue;
+		}
+		g_case = test.name;
+		if (auto error = error_of(test.run); !error.empty()) {
+			check(false, "unexpected exception: " + error);
+		}
+		++run;
+	}
+
+	error_code ec;
+	fs::remove_all(g_temp_dir, ec);
+	if (list) return 0;
+
+	printf("%zu cases, %zu checks, %zu failed\n", run, g_checks, g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
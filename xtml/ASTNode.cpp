@@ -5,45 +5,85 @@
 #include <map>
 #include <string>
 #include "Core.h"
+#include "Iterable.h"
+#include "TemplateProfiler.h"
+#include "Budget.h"
+#include <algorithm>
 
 using namespace std;
 
-EvalResult ASTNode::merge_results(const EvalResult& a, const EvalResult& b)
+void ASTNode::merge_results(EvalResult& into, const EvalResult& other)
 {
-	EvalResult result;
-	result.content = a.content + b.content;
+	// Append in place, loops merge once per child and iteration
+	into.content += other.content;
+	Budget::check_output(into.content.size());
+
+	bool should_break = into.should_break || other.should_break;
+	bool should_continue = !should_break && (into.should_continue || other.should_continue);
+	into.should_break = should_break;
+	into.should_continue = should_continue;
+}
 
-	if (a.should_break || b.should_break) {
-		result.should_break = true;
-	}else if (a.should_continue || b.should_continue) {
-		result.should_continue = true;
+VarDeclNode::VarDeclNode(const std::string& name, const std::string& expr) : m_name(name), m_expr(Vars::compile_expr(expr))
+{
+	auto tokens = Vars::parse_top_level_tokens(expr);
+	if (tokens.size() > 1 && tokens[0] == name) {
+		for (auto it = tokens.begin() + 1; it != tokens.end(); ++it) {
+			if (it->empty()) continue;
+			m_append_operands.push_back(Vars::compile_operand(*it));
+		}
 	}
-	return result;
 }
 
-EvalResult VarDeclNode::evaluate(std::map<std::string, var>& vars)
+EvalResult VarDeclNode::evaluate(VarMap& vars)
 {
+	// Appending to a string variable extends it in place instead of rebuilding it
+	if (!m_append_operands.empty()) {
+		auto it = vars.find(m_name);
+		if (it != vars.end() && it->second.type == DT_STRING) {
+			// Evaluate all operands first, they may read the variable itself
+			std::vector<var> operands;
+			operands.reserve(m_append_operands.size());
+			for (auto& operand : m_append_operands) {
+				operands.push_back(Vars::eval_operand(operand, vars));
+			}
+			for (auto& operand : operands) {
+				it->second.value += operand.value;
+			}
+			Budget::check_output(it->second.value.size());
+			return EvalResult{};
+		}
+	}
+
 	var value = Vars::eval_expr(m_expr, vars);
 	if (value.type != DT_UNKNOWN) {
-		vars[m_name] = value;
+		Budget::check_output(value.value.size());
+		vars[m_name] = std::move(value);
 	}
 	return EvalResult{};
 }
 
+EvalResult ASTNode::run(VarMap& vars)
+{
+	Budget::statement();
+	TemplateFrame frame(profile_frame, profile_line);
+	return evaluate(vars);
+}
+
 EvalResult ASTRoot::evaluate()
 {
 	EvalResult result;
 	for (auto& child : children) {
-		result.content += child->evaluate(vars).content;
+		result.content += child->run(vars).content;
 	}
 	return result;
 }
 
-EvalResult BlockNode::evaluate(std::map<std::string, var>& vars)
+EvalResult BlockNode::evaluate(VarMap& vars)
 {
 	EvalResult result;
 	for (auto& child : children) {
-		result = merge_results(result, child->evaluate(vars));
+		merge_results(result, child->run(vars));
 	}
 	return result;
 }
@@ -66,6 +106,7 @@ void IfStatementNode::add_branch(std::string condition, std::string content)
 {
 	Branch elif_branch;
 	elif_branch.condition = condition;
+	elif_branch.compiled = Statements::compile_condition(condition);
 	elif_branch.content = content;
 	this->parse_branch(elif_branch);
 	this->m_branches.push_back(std::move(elif_branch));
@@ -84,16 +125,18 @@ void IfStatementNode::add_else(std::string content)
 	}
 }
 
-EvalResult IfStatementNode::evaluate(std::map<std::string, var>& vars)
+EvalResult IfStatementNode::evaluate(VarMap& vars)
 {
 	// Evaluate children
 	EvalResult result;
 
 	bool resolved = false;
-	for (auto& if_branch : this->m_branches) {
-		if (Statements::evaluate_condition(if_branch.condition, if_branch.content, vars)) {
+	for (size_t i = 0; i < this->m_branches.size(); ++i) {
+		auto& if_branch = this->m_branches[i];
+		if (Statements::evaluate_condition(if_branch.compiled, vars)) {
+			TemplateFrame branch_scope(profile_frame.empty() ? std::string() : branch_frame(i, if_branch.condition));
 			for (auto& child : if_branch.children) {
-				result = merge_results(result, child->evaluate(vars));
+				merge_results(result, child->run(vars));
 			}
 			resolved = true;
 			break;
@@ -102,14 +145,22 @@ EvalResult IfStatementNode::evaluate(std::map<std::string, var>& vars)
 
 	// Else branch
 	if (!resolved && this->m_has_else) {
+		TemplateFrame branch_scope(profile_frame.empty() ? std::string() : branch_frame(this->m_branches.size(), "else"));
 		for (auto& child : this->m_else_branch.children) {
-			result = merge_results(result, child->evaluate(vars));
+			merge_results(result, child->run(vars));
 		}
 	}
 	return result;
 }
 
-EvalResult TextNode::evaluate(std::map<std::string, var>& vars)
+std::string IfStatementNode::branch_frame(size_t index, const std::string& condition) const
+{
+	auto frame = "branch " + std::to_string(index) + " (" + condition.substr(0, 60) + ")";
+	std::replace(frame.begin(), frame.end(), ';', ',');
+	return frame;
+}
+
+EvalResult TextNode::evaluate(VarMap& vars)
 {
 	EvalResult result;
 	auto value = Vars::eval_expr(m_value, vars);
@@ -121,7 +172,7 @@ EvalResult TextNode::evaluate(std::map<std::string, var>& vars)
 
 WhileNode::WhileNode(const std::string& condition, const std::string& body)
 {
-	m_condition = condition;
+	m_condition = Statements::compile_condition(condition);
 	auto statments = Core::split_statements(body);
 	auto childs = Core::parse_ast_statements(statments);
 	for (auto& child : childs) {
@@ -129,24 +180,25 @@ WhileNode::WhileNode(const std::string& condition, const std::string& body)
 	}
 }
 
-EvalResult WhileNode::evaluate(std::map<std::string, var>& vars)
+EvalResult WhileNode::evaluate(VarMap& vars)
 {
 	EvalResult result;
-	while (Statements::evaluate_condition(m_condition, "", vars)) {
+	while (Statements::evaluate_condition(m_condition, vars)) {
+		Budget::loop_iteration(m_condition.text);
 		for (auto& child : children) {
-			auto child_result = child->evaluate(vars);
+			auto child_result = child->run(vars);
 			if (child_result.should_break) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_break = false;
 				return result;
 			}
 			else if (child_result.should_continue) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_continue = false;
 				break;
 			}
 
-			result = merge_results(result, child_result);
+			merge_results(result, child_result);
 		}
 	}
 
@@ -166,9 +218,16 @@ ForNode::ForNode(const std::string& loop_expr, const std::string& body)
 		return;
 	}
 	m_init = Vars::trim_var(expressions[0]);
-	m_condition = Vars::trim_var(expressions[1]);
+	m_condition = Statements::compile_condition(Vars::trim_var(expressions[1]));
 	m_increment = Vars::trim_var(expressions[2]);
 
+	auto [init_key, init_value] = Vars::parse_var(m_init);
+	m_init_key = init_key;
+	m_init_value = Vars::compile_expr(init_value);
+	auto [inc_key, inc_value] = Vars::parse_var(m_increment);
+	m_increment_key = inc_key;
+	m_increment_value = Vars::compile_expr(inc_value);
+
 	auto statments = Core::split_statements(body);
 	auto childs = Core::parse_ast_statements(statments);
 	for (auto& child : childs) {
@@ -176,41 +235,40 @@ ForNode::ForNode(const std::string& loop_expr, const std::string& body)
 	}
 }
 
-EvalResult ForNode::evaluate(std::map<std::string, var>& vars)
+EvalResult ForNode::evaluate(VarMap& vars)
 {
 	// 1. Prepare the loop variable
-	auto [key, value] = Vars::parse_var(m_init);
-	auto var = Vars::eval_expr(value, vars);
+	auto var = Vars::eval_expr(m_init_value, vars);
 	if (var.type == DT_UNKNOWN) {
 		Utils::throw_err("Error: Failed to evaluate for loop init expression: " + m_init);
 	}
-	vars[key] = var;
+	vars[m_init_key] = var;
 
 	// 2. Execute the loop
 	EvalResult result;
-	while (Statements::evaluate_condition(m_condition, "", vars)) {
+	while (Statements::evaluate_condition(m_condition, vars)) {
+		Budget::loop_iteration(m_condition.text);
 		for (auto& child : children) {
-			auto child_result = child->evaluate(vars);
+			auto child_result = child->run(vars);
 			if (child_result.should_break) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_break = false;
 				return result;
 			}
 			else if (child_result.should_continue) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_continue = false;
 				break;
 			}
 
-			result = merge_results(result, child_result);
+			merge_results(result, child_result);
 		}
 
-		auto [inc_key, inc_value] = Vars::parse_var(m_increment);
-		auto inc_var = Vars::eval_expr(inc_value, vars);
+		auto inc_var = Vars::eval_expr(m_increment_value, vars);
 		if (inc_var.type == DT_UNKNOWN) {
 			Utils::throw_err("Error: Failed to evaluate for loop increment expression: " + m_increment);
 		}
-		vars[inc_key] = inc_var;
+		vars[m_increment_key] = inc_var;
 	}
 
 	return result;
@@ -218,12 +276,16 @@ EvalResult ForNode::evaluate(std::map<std::string, var>& vars)
 
 std::tuple<std::string, std::string> ForEachNode::parse_declaration(const std::string& declaration)
 {
-	auto parts = Utils::split(declaration, ' in ');
-	if (parts.size() != 3) {
+	// Split on the first " in " only, the collection may be an expression like std::range(0, n)
+	auto in_pos = declaration.find(" in ");
+	if (in_pos == std::string::npos) {
+		Utils::throw_err("Error: Invalid foreach declaration: " + declaration);
+	}
+	auto left = Utils::trim(Vars::trim_var(Utils::trim(declaration.substr(0, in_pos))));
+	auto right = Utils::trim(declaration.substr(in_pos + 4));
+	if (left.empty() || right.empty()) {
 		Utils::throw_err("Error: Invalid foreach declaration: " + declaration);
 	}
-	auto left = Vars::trim_var(parts[0]);
-	auto right = Vars::trim_var(parts[2]);
 
 	return std::make_tuple(left, right);
 }
@@ -233,6 +295,7 @@ ForEachNode::ForEachNode(const std::string& expression, const std::string& body)
 	auto [declaration, collection] = parse_declaration(expression);
 	m_declaration = declaration;
 	m_collection = collection;
+	m_collection_expr = Vars::compile_expr(collection);
 	auto statments = Core::split_statements(body);
 	auto childs = Core::parse_ast_statements(statments);
 	for (auto& child : childs) {
@@ -240,44 +303,62 @@ ForEachNode::ForEachNode(const std::string& expression, const std::string& body)
 	}
 }
 
-EvalResult ForEachNode::evaluate(std::map<std::string, var>& vars)
+EvalResult ForEachNode::evaluate(VarMap& vars)
 {
-	var collection_var = Vars::eval_expr(m_collection, vars);
-	if (collection_var.type != DT_ARRAY) {
+	// Plain variables are iterated in place instead of being copied out of the map
+	var evaluated;
+	const var* collection_var = nullptr;
+	auto var_it = vars.find(m_collection);
+	if (var_it != vars.end()) {
+		collection_var = &var_it->second;
+	}
+	else {
+		evaluated = Vars::eval_expr(m_collection_expr, vars);
+		collection_var = &evaluated;
+	}
+
+	std::unique_ptr<VarIterator> iterator;
+	if (collection_var->type == DT_ARRAY) {
+		iterator = std::make_unique<ArrayIterator>(collection_var->array);
+	}
+	else if (collection_var->type == DT_ITERABLE && collection_var->iterable) {
+		iterator = collection_var->iterable->iterate();
+	}
+	else {
 		Utils::throw_err("Error: Foreach collection is not an array: " + m_collection);
 	}
 
-	// Iteralte all elements in the array
+	// Pull the elements one by one straight into the loop variable
 	EvalResult result;
-	for (const auto& item : collection_var.array) {
-		vars[m_declaration] = item;
+	while (iterator->next(vars[m_declaration])) {
+		Budget::loop_iteration(m_collection);
 		for (auto& child : children) {
-			auto child_result = child->evaluate(vars);
+			auto child_result = child->run(vars);
 			if (child_result.should_break) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_break = false;
 				return result;
 			}
 			else if (child_result.should_continue) {
-				result = merge_results(result, child_result);
+				merge_results(result, child_result);
 				result.should_continue = false;
 				break;
 			}
 
-			result = merge_results(result, child_result);
+			merge_results(result, child_result);
 		}
 	}
 	return result;
 }
 
-EvalResult BreakNode::evaluate(std::map<std::string, var>& vars)
+EvalResult BreakNode::evaluate(VarMap& vars)
 {
 	EvalResult result;
 	result.should_break = true;
 	return result;
 }
 
-EvalResult ContinueNode::evaluate(std::map<std::string, var>& vars)
+EvalResult ContinueNode::evaluate(VarMap& vars)
 {
 	EvalResult result;
 	result.should_continue = true;
@@ -21,12 +21,15 @@ struct EvalResult {
 class ASTNode
 {
 protected:
-	virtual EvalResult merge_results(const EvalResult& a, const EvalResult& b);
+	virtual void merge_results(EvalResult& into, const EvalResult& other);
 
 public:
 	std::vector<std::unique_ptr<ASTNode>> children;
+	std::string profile_frame; // "file:line statement", only set while the template profiler is on
+	size_t profile_line = 0; // Line of profile_frame
 	virtual ~ASTNode() = default;
-	virtual EvalResult evaluate(std::map<std::string, var>& vars) = 0;
+	virtual EvalResult evaluate(VarMap& vars) = 0;
+	EvalResult run(VarMap& vars); // evaluate() with template profiler accounting
 
 	void add_child(std::unique_ptr<ASTNode> child) {
 		children.push_back(move(child));
@@ -40,7 +43,7 @@ class ASTRoot
 {
 public:
 	std::vector<std::unique_ptr<ASTNode>> children;
-	std::map<std::string, var> vars;
+	VarMap vars;
 	std::string built_content;
 	EvalResult evaluate();
 
@@ -48,7 +51,7 @@ public:
 		children.push_back(move(child));
 	}
 
-	void merge_vars(const std::map<std::string, var>& new_vars) {
+	void merge_vars(const VarMap& new_vars) {
 		for (const auto& [key, value] : new_vars) {
 			vars[key] = value;
 		}
@@ -61,7 +64,7 @@ public:
 class BlockNode : public ASTNode
 {
 public:
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 
@@ -72,10 +75,11 @@ class VarDeclNode : public ASTNode
 {
 private:
 	std::string m_name;
-	std::string m_expr;
+	CompiledExpr m_expr;
+	std::vector<CompiledExpr::Operand> m_append_operands; // Operands after "name +" for self-appends like "html = html + ..."
 public:
-	VarDeclNode(const std::string& name, const std::string& expr) : m_name(name), m_expr(expr) {}
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	VarDeclNode(const std::string& name, const std::string& expr);
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class IfStatementNode : public ASTNode
@@ -83,6 +87,7 @@ class IfStatementNode : public ASTNode
 	struct Branch
 	{
 		std::string condition;
+		CompiledCondition compiled;
 		std::string content;
 		std::vector<std::unique_ptr<ASTNode>> children;
 	};
@@ -93,70 +98,76 @@ private:
 	Branch m_else_branch;
 
 	void parse_branch(Branch& branch);
+	std::string branch_frame(size_t index, const std::string& condition) const;
 public:
 	IfStatementNode();
 	void add_branch(std::string condition, std::string content);
 	void add_else(std::string content);
 	bool is_empty() const { return m_branches.empty() && !m_has_else; }
 
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class TextNode : public ASTNode
 {
 private:
-	std::string m_value;
+	CompiledExpr m_value;
 public:
-	TextNode(const std::string& value) : m_value(value) {}
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	TextNode(const std::string& value) : m_value(Vars::compile_expr(value)) {}
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class WhileNode : public ASTNode
 {
 private:
-	std::string m_condition;
+	CompiledCondition m_condition;
 	std::vector<std::unique_ptr<ASTNode>> m_body;
 public:
 	WhileNode(const std::string& condition, const std::string& body);
 
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class ForNode : public ASTNode
 {
 private:
 	std::string m_init;
-	std::string m_condition;
+	std::string m_init_key;
+	CompiledExpr m_init_value;
+	CompiledCondition m_condition;
 	std::string m_increment;
+	std::string m_increment_key;
+	CompiledExpr m_increment_value;
 
 	void parse_loop(const std::string& loop_expr, const std::string& body);
 
 public:
 	ForNode(const std::string& loop_expr, const std::string& body);
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class ForEachNode : public ASTNode {
 private:
 	std::string m_collection;
+	CompiledExpr m_collection_expr;
 	std::string m_declaration;
 
 	std::tuple<std::string, std::string> parse_declaration(const std::string& declaration);
 public:
 	ForEachNode(const std::string& expression, const std::string& body);
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class BreakNode : public ASTNode
 {
 public:
 	BreakNode() {}
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
 
 class ContinueNode : public ASTNode
 {
 public:
 	ContinueNode() {}
-	EvalResult evaluate(std::map<std::string, var>& vars) override;
+	EvalResult evaluate(VarMap& vars) override;
 };
\ No newline at end of file
@@ -0,0 +1,19 @@
+#include "AllocProfiler.h"
+#include <cstddef>
+#include <new>
+
+// Counting allocator for --profile-memory. This file is part of the executable only
+// (excluded from the xtmlLib configurations), so applications embedding xtmlLib keep
+// their own operator new.
+void* operator new(size_t size) { return AllocProfiler::allocate(size); }
+void* operator new[](size_t size) { return AllocProfiler::allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocProfiler::allocate_aligned(size, size_t(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocProfiler::allocate_aligned(size, size_t(alignment)); }
+void operator delete(void* ptr) noexcept { AllocProfiler::deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { AllocProfiler::deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { AllocProfiler::deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { AllocProfiler::deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { AllocProfiler::deallocate_aligned(ptr, size_t(alignment)); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { AllocProfiler::deallocate_aligned(ptr, size_t(alignment)); }
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept { AllocProfiler::deallocate_aligned(ptr, size_t(alignment)); }
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept { AllocProfiler::deallocate_aligned(ptr, size_t(alignment)); }
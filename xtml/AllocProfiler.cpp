@@ -0,0 +1,117 @@
+#include "AllocProfiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#define usable_size(ptr) _msize(ptr)
+#define usable_size_aligned(ptr, alignment) _aligned_msize(ptr, alignment, 0)
+#else
+#include <malloc.h>
+#define usable_size(ptr) malloc_usable_size(ptr)
+#define usable_size_aligned(ptr, alignment) malloc_usable_size(ptr)
+#endif
+
+using namespace std;
+
+std::atomic<bool> AllocProfiler::s_enabled(false);
+
+namespace {
+	atomic<int64_t> process_live(0);
+	atomic<int64_t> process_peak(0);
+
+	void record_alloc(size_t requested, size_t usable)
+	{
+		auto& counters = AllocProfiler::thread_counters();
+		counters.count++;
+		counters.bytes += requested;
+		counters.live += usable;
+		counters.peak = max(counters.peak, counters.live);
+
+		auto live = process_live.fetch_add(usable, memory_order_relaxed) + static_cast<int64_t>(usable);
+		auto peak = process_peak.load(memory_order_relaxed);
+		while (live > peak && !process_peak.compare_exchange_weak(peak, live, memory_order_relaxed)) {}
+	}
+
+	void record_free(size_t usable)
+	{
+		AllocProfiler::thread_counters().live -= usable;
+		process_live.fetch_sub(usable, memory_order_relaxed);
+	}
+}
+
+AllocCounters& AllocProfiler::thread_counters()
+{
+	// Trivially constructed, so using it from inside operator new never allocates
+	thread_local AllocCounters counters;
+	return counters;
+}
+
+int64_t AllocProfiler::process_peak_bytes()
+{
+	return process_peak.load(memory_order_relaxed);
+}
+
+void AllocProfiler::reset_process_peak()
+{
+	process_peak.store(process_live.load(memory_order_relaxed), memory_order_relaxed);
+}
+
+void* AllocProfiler::allocate(size_t size)
+{
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr) throw bad_alloc();
+	if (enabled()) record_alloc(size, usable_size(ptr));
+	return ptr;
+}
+
+void* AllocProfiler::allocate_aligned(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+	void* ptr = _aligned_malloc(size ? size : 1, alignment);
+#else
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, max(alignment, sizeof(void*)), size ? size : 1) != 0) ptr = nullptr;
+#endif
+	if (!ptr) throw bad_alloc();
+	if (enabled()) record_alloc(size, usable_size_aligned(ptr, alignment));
+	return ptr;
+}
+
+void AllocProfiler::deallocate(void* ptr)
+{
+	if (!ptr) return;
+	if (enabled()) record_free(usable_size(ptr));
+	free(ptr);
+}
+
+void AllocProfiler::deallocate_aligned(void* ptr, size_t alignment)
+{
+	if (!ptr) return;
+	if (enabled()) record_free(usable_size_aligned(ptr, alignment));
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+void AllocMark::begin()
+{
+	auto& counters = AllocProfiler::thread_counters();
+	m_count = counters.count;
+	m_bytes = counters.bytes;
+	m_live = counters.live;
+	m_outer_peak = counters.peak;
+	counters.peak = counters.live;
+}
+
+void AllocMark::end(uint64_t& count, uint64_t& bytes, uint64_t& peak)
+{
+	auto& counters = AllocProfiler::thread_counters();
+	count += counters.count - m_count;
+	bytes += counters.bytes - m_bytes;
+	peak = max(peak, static_cast<uint64_t>(max<int64_t>(0, counters.peak - m_live)));
+	counters.peak = max(m_outer_peak, counters.peak);
+}
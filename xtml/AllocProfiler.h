@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// Heap counters of one thread. live can drop below zero when memory allocated
+/// on another thread (or before profiling started) is freed here.
+/// </summary>
+struct AllocCounters {
+	uint64_t count = 0;
+	uint64_t bytes = 0; // Requested bytes
+	int64_t live = 0; // Usable bytes currently allocated
+	int64_t peak = 0; // Highest live value since the innermost AllocMark began
+};
+
+/// <summary>
+/// Allocation accounting switched on with --profile-memory. The counting allocator
+/// is installed by the executable (replacement operator new / delete in AllocHooks.cpp)
+/// and forwards to malloc; while disabled it costs one relaxed atomic load.
+/// </summary>
+class AllocProfiler
+{
+private:
+	static std::atomic<bool> s_enabled;
+public:
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void set_enabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+	// Counting malloc / free, used by the replacement operators
+	static void* allocate(size_t size);
+	static void* allocate_aligned(size_t size, size_t alignment);
+	static void deallocate(void* ptr);
+	static void deallocate_aligned(void* ptr, size_t alignment);
+
+	static AllocCounters& thread_counters();
+	static int64_t process_peak_bytes(); // Highest live heap of all threads together
+	static void reset_process_peak();
+};
+
+/// <summary>
+/// Measures the allocations between begin and end on the calling thread. Marks
+/// nest: the peak seen by an inner mark is carried over to the outer one.
+/// </summary>
+class AllocMark
+{
+private:
+	uint64_t m_count = 0;
+	uint64_t m_bytes = 0;
+	int64_t m_live = 0;
+	int64_t m_outer_peak = 0;
+public:
+	void begin();
+	// Adds the allocation count and bytes since begin, raises peak to the growth of live bytes
+	void end(uint64_t& count, uint64_t& bytes, uint64_t& peak);
+};
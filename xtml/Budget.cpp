@@ -0,0 +1,128 @@
+#include "Budget.h"
+#include "RenderContext.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+using namespace std;
+
+BudgetLimits Budget::default_limits;
+
+namespace {
+	// The clock is read every this many probes when a wall time limit is set
+	const uint32_t clock_interval = 256;
+
+	uint64_t limit_or_max(uint64_t limit)
+	{
+		return limit ? limit : UINT64_MAX;
+	}
+}
+
+BudgetState& Budget::state()
+{
+	thread_local BudgetState instance;
+	return instance;
+}
+
+void Budget::exceeded(const string& what, const string& where)
+{
+	auto& s = state();
+	auto message = "Error: Render budget exceeded: " + what;
+	if (!s.file.empty()) message += " in " + s.file;
+	if (!where.empty()) message += " (loop: " + where + ")";
+	Utils::throw_err(message);
+}
+
+void Budget::check_slow(const string& where)
+{
+	auto& s = state();
+	if (s.statements > s.max_statements) {
+		exceeded("more than " + to_string(s.max_statements) + " statements evaluated");
+	}
+	if (s.loop_iterations > s.max_loop_iterations) {
+		exceeded("more than " + to_string(s.max_loop_iterations) + " loop iterations", where);
+	}
+	if (s.clock_countdown == 0) {
+		s.clock_countdown = clock_interval;
+		if (s.deadline_ns != UINT64_MAX && Profiler::wall_now_ns() > s.deadline_ns) {
+			exceeded("more than " + to_string(s.wall_ms) + " ms wall time", where);
+		}
+	}
+}
+
+namespace {
+	uint64_t* option_target(const string& option, BudgetLimits& limits)
+	{
+		if (option == "--max-statements") return &limits.statements;
+		if (option == "--max-iterations") return &limits.loop_iterations;
+		if (option == "--max-output") return &limits.output_bytes;
+		if (option == "--max-include-depth") return &limits.include_depth;
+		if (option == "--timeout") return &limits.wall_ms;
+		return nullptr;
+	}
+}
+
+bool Budget::is_option(const string& option)
+{
+	BudgetLimits limits;
+	return option_target(option, limits) != nullptr;
+}
+
+bool Budget::set_option(const string& option, const string& value, BudgetLimits& limits)
+{
+	auto target = option_target(option, limits);
+	if (!target || !Utils::is_number(value) || value.size() > 18) {
+		return false;
+	}
+	*target = stoull(value);
+	return true;
+}
+
+const char* Budget::options_usage()
+{
+	return "[--max-statements <n>] [--max-iterations <n>] [--max-output <bytes>] [--max-include-depth <n>] [--timeout <ms>]";
+}
+
+BudgetScope::BudgetScope(const string& file) : m_active(!Budget::state().active)
+{
+	if (!m_active) return;
+	auto& limits = RenderContext::current().budget_limits ? *RenderContext::current().budget_limits : Budget::default_limits;
+	auto& s = Budget::state();
+	s.active = true;
+	s.statements = 0;
+	s.loop_iterations = 0;
+	s.include_depth = 0;
+	s.max_statements = limit_or_max(limits.statements);
+	s.max_loop_iterations = limit_or_max(limits.loop_iterations);
+	s.max_output_bytes = limit_or_max(limits.output_bytes);
+	s.max_include_depth = limit_or_max(limits.include_depth);
+	s.wall_ms = limits.wall_ms;
+	s.deadline_ns = limits.wall_ms ? Profiler::wall_now_ns() + limits.wall_ms * 1000000ull : UINT64_MAX;
+	s.clock_countdown = clock_interval;
+	s.file = file;
+}
+
+BudgetScope::~BudgetScope()
+{
+	if (!m_active) return;
+	// Probes outside of a render (e.g. benchmarks evaluating nodes directly) never trip
+	Budget::state() = BudgetState();
+}
+
+BudgetIncludeScope::BudgetIncludeScope(const string& file)
+{
+	auto& s = Budget::state();
+	if (++s.include_depth > s.max_include_depth) {
+		--s.include_depth;
+		auto limit = s.max_include_depth;
+		Utils::throw_err("Error: Render budget exceeded: more than " + to_string(limit) + " nested includes at " + file + (s.file.empty() ? "" : " (included from " + s.file + ")"));
+	}
+	m_previous_file = move(s.file);
+	s.file = file;
+}
+
+BudgetIncludeScope::~BudgetIncludeScope()
+{
+	auto& s = Budget::state();
+	--s.include_depth;
+	s.file = move(m_previous_file);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// Execution limits of one render, 0 means unlimited
+/// </summary>
+struct BudgetLimits {
+	uint64_t statements = 0; // Evaluated AST statements
+	uint64_t loop_iterations = 0; // Iterations of all loops together
+	uint64_t output_bytes = 0; // Size of any generated text: block output, string variable or page
+	uint64_t include_depth = 64; // Nested includes, stops include cycles before the stack overflows
+	uint64_t wall_ms = 0; // Wall time of the render
+};
+
+/// <summary>
+/// Counters of the render running on this thread. Limits of 0 are stored as UINT64_MAX,
+/// so a probe is an increment and a compare.
+/// </summary>
+struct BudgetState {
+	bool active = false;
+	uint64_t statements = 0;
+	uint64_t loop_iterations = 0;
+	uint64_t include_depth = 0;
+	uint64_t max_statements = UINT64_MAX;
+	uint64_t max_loop_iterations = UINT64_MAX;
+	uint64_t max_output_bytes = UINT64_MAX;
+	uint64_t max_include_depth = UINT64_MAX;
+	uint64_t wall_ms = 0;
+	uint64_t deadline_ns = UINT64_MAX;
+	uint32_t clock_countdown = 1; // Probes left until the wall clock is read again
+	std::string file; // Template being evaluated, for diagnostics
+};
+
+/// <summary>
+/// Watchdog for template evaluation. Every statement, loop iteration and generated
+/// text is checked against the limits of the current render (RenderContext::budget,
+/// default Budget::default_limits); exceeding one throws with a diagnostic naming
+/// the limit and the template, so a runaway page fails instead of stalling its worker.
+/// </summary>
+class Budget
+{
+private:
+	static void exceeded(const std::string& what, const std::string& where = "");
+	static void check_slow(const std::string& where);
+public:
+	static BudgetLimits default_limits;
+
+	static BudgetState& state();
+
+	// Probes, called from the evaluation loop
+	static void statement()
+	{
+		auto& s = state();
+		if (++s.statements > s.max_statements || --s.clock_countdown == 0) check_slow("");
+	}
+	static void loop_iteration(const std::string& loop)
+	{
+		auto& s = state();
+		if (++s.loop_iterations > s.max_loop_iterations || --s.clock_countdown == 0) check_slow(loop);
+	}
+	static void check_output(size_t size)
+	{
+		if (size > state().max_output_bytes) exceeded("more than " + std::to_string(state().max_output_bytes) + " bytes of output");
+	}
+
+	// Command line options: --max-statements, --max-iterations, --max-output, --max-include-depth, --timeout
+	static bool is_option(const std::string& option);
+	static bool set_option(const std::string& option, const std::string& value, BudgetLimits& limits); // False if value is not a number
+	static const char* options_usage();
+};
+
+/// <summary>
+/// Starts the budget of a render on this thread. Nested scopes (e.g. a render
+/// started from inside another one) share the outer budget.
+/// </summary>
+class BudgetScope
+{
+private:
+	bool m_active;
+public:
+	explicit BudgetScope(const std::string& file);
+	~BudgetScope();
+
+	BudgetScope(const BudgetScope&) = delete;
+	BudgetScope& operator=(const BudgetScope&) = delete;
+};
+
+/// <summary>
+/// One include level for the lifetime of the scope
+/// </summary>
+class BudgetIncludeScope
+{
+private:
+	std::string m_previous_file;
+public:
+	explicit BudgetIncludeScope(const std::string& file);
+	~BudgetIncludeScope();
+
+	BudgetIncludeScope(const BudgetIncludeScope&) = delete;
+	BudgetIncludeScope& operator=(const BudgetIncludeScope&) = delete;
+};
@@ -2,12 +2,27 @@
 #include <regex>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 #include "Utils.h"
+#include "Logger.h"
 #include "Vars.h"
 #include "Statements.h"
+#include "Scanner.h"
+#include "Minifier.h"
+#include "Escaper.h"
+#include "RenderContext.h"
+#include "Json.h"
+#include "Csv.h"
+#include "Profiler.h"
+#include "TemplateProfiler.h"
+#include "Tracer.h"
+#include "Budget.h"
+#include "FunctionRegistry.h"
 
 using namespace std;
 
+MinifyOptions Core::minify_options;
+
 /// <summary>
 /// Parse content into blocks based on start and end tags
 /// </summary>
@@ -37,9 +52,9 @@ vector<string> Core::parse_blocks(const string& content, const string& start_tag
 /// </summary>
 /// <param name="content"></param>
 /// <returns></returns>
-map<string, var> Core::parse_block(const std::string& content, map<string, var>& vars)
+VarMap Core::parse_block(const std::string& content, VarMap& vars)
 {
-	map<string, var> local_vars;
+	VarMap local_vars;
 	local_vars.insert(vars.begin(), vars.end());
 
 	// split parts on ;
@@ -75,11 +90,16 @@ map<string, var> Core::parse_block(const std::string& content, map<string, var>&
 /// <param name="tag"></param>
 /// <param name="resolve_global"></param>
 /// <returns></returns>
-string Core::resolve_include(const string& include_path, map<string, var>& vars, XtmlTag tag, bool resolve_global)
+string Core::resolve_include(const string& include_path, VarMap& vars, XtmlTag tag, bool resolve_global)
 {
+	ProfileScope profile(PS_RESOLVE_INCLUDE);
+	TraceSpan trace("include", Tracer::enabled() ? "include " + include_path : string());
+	TemplateFrame profile_frame(TemplateProfiler::enabled() ? TemplateProfiler::frame_label("include " + Utils::file_name(include_path)) : string());
+	TemplateFileScope profile_file(include_path);
+	BudgetIncludeScope budget(include_path);
 	// Resolve an include directive
-	Utils::print_ln("Resolving include: " + include_path);
-	map<string, var> local_vars;
+	if (Logger::enabled(LL_DEBUG)) Utils::log(LL_DEBUG, "Resolving include: " + include_path);
+	VarMap local_vars;
 
 	// Copy global vars to local if resolve as global
 	if (resolve_global) {
@@ -95,7 +115,7 @@ string Core::resolve_include(const string& include_path, map<string, var>& vars,
 
 	// Read and build included content
 	auto include_content = Utils::read_file(include_path);
-	Utils::print_ln("Processing include: " + include_path);
+	if (Logger::enabled(LL_TRACE)) Utils::log(LL_TRACE, "Processing include: " + include_path);
 	include_content = build_content(include_content, Utils::file_path_parent(include_path), local_vars);
 
 	// Merge local vars back to global if resolve as global
@@ -115,6 +135,7 @@ string Core::resolve_include(const string& include_path, map<string, var>& vars,
 /// <returns></returns>
 string Core::remove_blocks(const string& content, const string& start_tag, const string& end_tag)
 {
+	ProfileScope profile(PS_REMOVE_BLOCKS);
 	// Remove blocks from content based on start and end tags
 	string pattern = start_tag + "[\\s\\S]*?" + end_tag;
 	regex re(pattern);
@@ -123,24 +144,15 @@ string Core::remove_blocks(const string& content, const string& start_tag, const
 }
 
 /// <summary>
-/// Clean content by removing comments and trimming whitespace
+/// Clean content with the minifier stage configured for this render (default: Core::minify_options)
 /// </summary>
 /// <param name="content"></param>
 /// <returns></returns>
 string Core::clean_content(string& content)
 {
-	// Remove comments and trim whitespace
-	std::istringstream stream(content);
-	std::string line;
-	std::string cleaned;
-	while (std::getline(stream, line)) {
-		line = Utils::trim(line);
-		if (line.starts_with("@var")) {
-			continue;
-		}
-		cleaned += line + "\n";
-	}
-	return cleaned;
+	ProfileScope profile(PS_CLEAN_CONTENT);
+	auto options = RenderContext::current().minify_options;
+	return Minifier::minify(content, options ? *options : minify_options);
 }
 
 /// <summary>
@@ -149,9 +161,14 @@ string Core::clean_content(string& content)
 /// <param name="path"></param>
 /// <param name="vars"></param>
 /// <returns></returns>
-string Core::build_file(const string& path, map<string, var>& vars)
+string Core::build_file(const string& path, VarMap& vars)
 {
-	Utils::print_ln(string("Building file ") + path);
+	if (Logger::enabled(LL_INFO)) Utils::log(LL_INFO, "Building file " + path);
+	TraceSpan trace("build", Tracer::enabled() ? "build " + path : string());
+	TemplateFileScope profile_file(path);
+	TemplateFrame profile_frame(TemplateProfiler::enabled() ? Utils::file_name(path) : string());
+	BudgetScope budget(path);
+	FunctionRegistry::ReadScope functions; // One for the whole build, the ones around each call are nested
 	auto content = Utils::read_file(path);
 	auto base_path = Utils::file_path_parent(path);
 
@@ -165,14 +182,41 @@ string Core::build_file(const string& path, map<string, var>& vars)
 /// <param name="base_path"></param>
 /// <param name="vars"></param>
 /// <returns></returns>
-std::string Core::build_content(string& content, string base_path, map<string, var>& vars)
+std::string Core::build_content(string& content, string base_path, VarMap& vars)
 {
 	auto ast_root = std::make_unique<ASTRoot>();
 	ast_root->merge_vars(vars); // Initialize with global vars
+	EscapeMode escape_mode = ESC_RAW;
 
 	auto blocks = Core::find_xtml_tags(content);
-	for (const auto& block : blocks) {
+	vector<size_t> block_lines;
+	if (TemplateProfiler::enabled()) {
+		// Lines refer to the unmodified content, before any block is replaced
+		size_t line = 1;
+		size_t counted = 0;
+		for (const auto& block : blocks) {
+			size_t offset = content.find(block.full);
+			if (offset != string::npos && offset >= counted) {
+				line += std::count(content.begin() + counted, content.begin() + offset, '\n');
+				counted = offset;
+			}
+			block_lines.push_back(line);
+		}
+	}
+
+	for (size_t block_index = 0; block_index < blocks.size(); ++block_index) {
+		const auto& block = blocks[block_index];
 		auto block_node = std::make_unique<BlockNode>();
+		if (TemplateProfiler::enabled()) {
+			TemplateProfiler::set_line(block_lines[block_index]);
+		}
+		if (block.self_closing && block.attributes.find("escape") != block.attributes.end()) {
+			// Default escaping for the placeholders of this template e.g. <xtml escape="html" />
+			auto mode_name = Utils::trim(block.attributes.at("escape"));
+			if (!Escaper::parse_mode(mode_name, escape_mode)) {
+				Utils::throw_err("Error: Unknown escape mode: " + mode_name);
+			}
+		}
 		if (block.self_closing && block.attributes.find("include") != block.attributes.end()) {
 			bool resolve_global = true;
 			if (block.attributes.find("resolve") != block.attributes.end()) {
@@ -181,10 +225,20 @@ std::string Core::build_content(string& content, string base_path, map<string, v
 					resolve_global = false;
 				}
 			}
-			auto include_path = base_path + "\\" + Utils::trim(block.attributes.at("include"));
+			auto include_path = Utils::join_path(base_path, Utils::trim(block.attributes.at("include")));
 			auto include_content = Core::resolve_include(include_path, ast_root->vars, block, resolve_global);
 			content = Utils::replace(content, block.full, include_content);
 		}
+		else if (block.self_closing && block.attributes.find("data") != block.attributes.end()) {
+			// Load a data file into a variable e.g. <xtml data="posts.jsonl" as="posts" />
+			auto as_it = block.attributes.find("as");
+			if (as_it == block.attributes.end() || Utils::trim(as_it->second).empty()) {
+				Utils::throw_err("Error: Data tag requires an 'as' attribute: " + block.full);
+			}
+			auto data_path = Utils::join_path(base_path, Utils::trim(block.attributes.at("data")));
+			ast_root->vars[Utils::trim(as_it->second)] = Core::load_data(data_path);
+			content = Utils::replace(content, block.full, "");
+		}
 		else if (block.self_closing && block.attributes.find("define") != block.attributes.end()) {
 			// Resolve self-closing var declaration later Todo
 			auto [var_key, var_value] = Core::resolve_self_closing_var(block);
@@ -194,18 +248,55 @@ std::string Core::build_content(string& content, string base_path, map<string, v
 
 		auto preprocessed = Vars::preprocess_content(block.content);
 		auto statements = Core::split_statements(preprocessed);
-		auto childs = parse_ast_statements(statements);
+		vector<size_t> statement_lines;
+		if (TemplateProfiler::enabled()) {
+			// Preprocessing only drops whitespace, so splitting the raw block yields the same statements with their lines
+			size_t head_line = block_lines[block_index] + std::count(block.head.begin(), block.head.end(), '\n');
+			TemplateProfiler::set_line(head_line);
+			block_node->profile_frame = TemplateProfiler::frame_label("<xtml>");
+			block_node->profile_line = head_line;
+			vector<size_t> offsets;
+			Core::split_statements(block.content, &offsets);
+			size_t line = head_line;
+			size_t counted = 0;
+			for (size_t offset : offsets) {
+				line += std::count(block.content.begin() + counted, block.content.begin() + offset, '\n');
+				counted = offset;
+				statement_lines.push_back(line);
+			}
+			if (statement_lines.size() < statements.size()) {
+				statement_lines.clear();
+			}
+		}
+		auto childs = parse_ast_statements(statements, statement_lines.empty() ? nullptr : &statement_lines);
 		for (auto& child : childs) {
 			block_node->add_child(move(child));
 		}
 		// Evaluate AST to resolve includes and var declarations
-		auto evaluated_block = block_node->evaluate(ast_root->vars);
+		EvalResult evaluated_block;
+		{
+			ProfileScope profile(PS_EVALUATE);
+			evaluated_block = block_node->run(ast_root->vars);
+		}
 		content = Utils::replace(content, block.full, evaluated_block.content);
 		ast_root->add_child(move(block_node));
 		// Exchange content with evaluated content
 	}
 
-	content = resolve_placeholders(content, ast_root->vars);
+	return finish_content(content, ast_root->vars, escape_mode);
+}
+
+/// <summary>
+/// Resolve placeholders of content whose blocks have been replaced and clean up the output
+/// </summary>
+/// <param name="content"></param>
+/// <param name="vars"></param>
+/// <param name="escape_mode"></param>
+/// <returns></returns>
+string Core::finish_content(string& content, const VarMap& vars, EscapeMode escape_mode)
+{
+	content = resolve_placeholders(content, vars, escape_mode);
+	Budget::check_output(content.size());
 
 	// Check for unresolved variables
 	auto unresolved = Core::find_unresolved_vars(content);
@@ -223,10 +314,23 @@ std::string Core::build_content(string& content, string base_path, map<string, v
 	content = Utils::trim(content);
 
 
-	Utils::print_ln("Build completed.");
+	if (Logger::enabled(LL_INFO)) Utils::log(LL_INFO, "Build completed.");
 	return content;
 }
 
+/// <summary>
+/// Load a data file as a variable. CSV files become lazily decoded rows, everything else is read as JSON / JSON Lines.
+/// </summary>
+/// <param name="path"></param>
+/// <returns></returns>
+var Core::load_data(const std::string& path)
+{
+	if (Utils::ends_with(path, ".csv")) {
+		return Csv::load_file(path);
+	}
+	return Json::load_file(path);
+}
+
 /// <summary>
 /// Write content to a file
 /// </summary>
@@ -234,6 +338,8 @@ std::string Core::build_content(string& content, string base_path, map<string, v
 /// <param name="output_path"></param>
 void Core::write_file(const string& content, const string& output_path)
 {
+	ProfileScope profile(PS_WRITE_FILE);
+	TraceSpan trace("io", Tracer::enabled() ? "write " + output_path : string());
 	std::ofstream file(output_path);
 	if (!file.is_open()) {
 		throw std::runtime_error("Could not create file: " + output_path);
@@ -248,34 +354,44 @@ void Core::write_file(const string& content, const string& output_path)
 /// <param name="content"></param>
 /// <returns></returns>
 vector<XtmlTag> Core::find_xtml_tags(const string& content) {
+	ProfileScope profile(PS_FIND_TAGS);
 	vector<XtmlTag> tags;
 
-	// Kombinierte Regex:
-	// 1. Alternative: self-closing <xtml ... />
-	// 2. Alternative: block <xtml ...> ... </xtml>
-	// ([\s\S]*?) wird benutzt als dotall-Ersatz fr inneren Inhalt
-	regex re(R"(<xtml\b([^>]*)\/>|<xtml\b([^>]*)>([\s\S]*?)<\/xtml>)");
+	// Matches the same tags as the former regex
+	// <xtml\b([^>]*)\/>|<xtml\b([^>]*)>([\s\S]*?)<\/xtml>
+	// but only stops at '<' bytes, which the scanner finds in bulk.
+	string_view text = content;
+	size_t pos = 0;
+	while ((pos = Scanner::find_either(text, '<', '<', pos)) != Scanner::npos) {
+		if (text.compare(pos, 5, "<xtml") != 0 || (pos + 5 < text.size() && (isalnum(static_cast<unsigned char>(text[pos + 5])) || text[pos + 5] == '_'))) {
+			++pos;
+			continue;
+		}
 
-	auto it = sregex_iterator(content.begin(), content.end(), re);
-	auto end = sregex_iterator();
+		size_t head_end = text.find('>', pos + 5);
+		if (head_end == string_view::npos) break;
 
-	for (; it != end; ++it) {
-		smatch m = *it;
 		XtmlTag tag;
-
-		if (m[1].matched) {
-			// matched first alternative: self-closing
-			tag.full = m.str(0);
-			tag.head = string("<xtml") + m[1].str() + "/>";
-			tag.content = "";
+		tag.offset = pos;
+		if (head_end > pos + 5 && text[head_end - 1] == '/') {
+			// self-closing <xtml ... />
+			tag.full = string(text.substr(pos, head_end + 1 - pos));
+			tag.head = tag.full;
 			tag.self_closing = true;
+			pos = head_end + 1;
 		}
 		else {
-			// matched second alternative: block
-			tag.full = m.str(0);
-			tag.head = string("<xtml") + m[2].str() + ">";
-			tag.content = m[3].str();
+			// block <xtml ...> ... </xtml>
+			size_t close = Scanner::find(text, "</xtml>", head_end + 1);
+			if (close == Scanner::npos) {
+				++pos;
+				continue;
+			}
+			tag.full = string(text.substr(pos, close + 7 - pos));
+			tag.head = string(text.substr(pos, head_end + 1 - pos));
+			tag.content = string(text.substr(head_end + 1, close - head_end - 1));
 			tag.self_closing = false;
+			pos = close + 7;
 		}
 
 		tag.attributes = Core::parse_xtml_attributes(tag.head);
@@ -295,7 +411,8 @@ map<string, string> Core::parse_xtml_attributes(const string& tag)
 	map<string, string> attributes;
 	// Example tag: <tag attr1="value1" attr2='value2'>
     //regex re(R"((\w+)\s*=\s*\"([^\"]*)\")");
-	regex re(R"(([\w-]+)\s*=\s*\"([^\"]*)\")");
+	// Built once: constructing the regex cost more than scanning the whole page for tags
+	static const regex re(R"(([\w-]+)\s*=\s*\"([^\"]*)\")");
 	auto beginn = sregex_iterator(tag.begin(), tag.end(), re);
 	auto endd = sregex_iterator();
 	for (auto i = beginn; i != endd; ++i) {
@@ -312,10 +429,10 @@ map<string, string> Core::parse_xtml_attributes(const string& tag)
 /// </summary>
 /// <param name="params"></param>
 /// <returns></returns>
-map<string, var> Core::params_to_vars(const map<string, string>& params)
+VarMap Core::params_to_vars(const map<string, string>& params)
 {
 	// Convert string parameters to var types
-	map<string, var> vars;
+	VarMap vars;
 	for (const auto& [key, value] : params) {
 		if (Utils::starts_with(key, "param-")) {
 			auto new_key = key.substr(6);
@@ -333,10 +450,22 @@ map<string, var> Core::params_to_vars(const map<string, string>& params)
 /// <returns></returns>
 vector<string> Core::find_unresolved_vars(const string& content)
 {
+	// Placeholders of the form {{@name}} with name made of [a-zA-Z0-9_]
 	vector<string> unresolved;
-	std::regex re(R"(\{\{@([a-zA-Z0-9_]+)\}\})");
-	for (auto it = std::sregex_iterator(content.begin(), content.end(), re); it != std::sregex_iterator(); ++it) {
-		unresolved.push_back(it->str(1));
+	string_view text = content;
+	size_t pos = 0;
+	while ((pos = Scanner::find(text, "{{@", pos)) != Scanner::npos) {
+		size_t name_end = pos + 3;
+		while (name_end < text.size() && (isalnum(static_cast<unsigned char>(text[name_end])) || text[name_end] == '_')) {
+			++name_end;
+		}
+		if (name_end > pos + 3 && text.compare(name_end, 2, "}}") == 0) {
+			unresolved.push_back(string(text.substr(pos + 3, name_end - pos - 3)));
+			pos = name_end + 2;
+		}
+		else {
+			++pos;
+		}
 	}
 	return unresolved;
 }
@@ -390,45 +519,90 @@ tuple<string, var> Core::resolve_self_closing_var(XtmlTag tag)
 	}
 }
 
-std::string Core::resolve_placeholders(const std::string& content, const std::map<std::string, var>& vars)
+std::string Core::resolve_placeholders(const std::string& content, const VarMap& vars, EscapeMode escape_mode)
 {
+	ProfileScope profile(PS_RESOLVE_PLACEHOLDERS);
 	// Resolving playeholders like {{@varName}} or {{namespace::funcName(arg1, arg2)}}
+	// A placeholder is "{{", one or more bytes other than '}', then "}}".
+	// An escape mode can be appended per placeholder e.g. {{@title|attr}} or {{@html|raw}}
 
-	map<string, var> results;
-	string result = content;
-	regex re(R"(\{\{([^\}]+)\}\})");
-
-	auto it = sregex_iterator(content.begin(), content.end(), re);
-	auto end = sregex_iterator();
-
-	for (; it != end; ++it) {
-		std::smatch match = *it;
-		std::string placeholder = match.str(0); // Full match including {{}}
-		std::string inner = match.str(1); // Inner content
-
-		inner = Utils::trim(inner);
-		if (inner[0] == '@') {
-			string var_name = inner.substr(1);
-			var var_val = Vars::eval_expr(var_name, vars);
-			results[placeholder] = var_val;
-		}
-		else if (Vars::is_function_expr(inner)) {
-			var func_val = Vars::eval_func_expr(inner, vars);
-			results[placeholder] = func_val;
+	map<string, tuple<var, EscapeMode>, less<>> results;
+	string result;
+	result.reserve(content.size());
+	string_view text = content;
+	size_t copied = 0;
+	size_t pos = 0;
+
+	while ((pos = Scanner::find(text, "{{", pos)) != Scanner::npos) {
+		size_t inner_end = text.find('}', pos + 2);
+		if (inner_end == string_view::npos) break;
+		if (inner_end == pos + 2 || text.compare(inner_end, 2, "}}") != 0) {
+			++pos;
+			continue;
 		}
-		else {
-			Utils::throw_err("Error: Unknown placeholder format: " + placeholder);
+
+		string_view placeholder = text.substr(pos, inner_end + 2 - pos); // Full match including {{}}
+		auto cached = results.find(placeholder);
+		if (cached == results.end()) {
+			string inner = Utils::trim(text.substr(pos + 2, inner_end - pos - 2)); // Inner content
+			EscapeMode mode = escape_mode;
+			if (auto filter_pos = find_escape_filter(inner); filter_pos != string::npos) {
+				Escaper::parse_mode(Utils::trim_view(string_view(inner).substr(filter_pos + 1)), mode);
+				inner = Utils::trim(string_view(inner).substr(0, filter_pos));
+			}
+			var value;
+			if (inner[0] == '@') {
+				string var_name = inner.substr(1);
+				value = Vars::eval_expr(var_name, vars);
+			}
+			else if (Vars::is_function_expr(inner)) {
+				value = Vars::eval_func_expr(inner, vars);
+			}
+			else {
+				Utils::throw_err("Error: Unknown placeholder format: " + string(placeholder));
+			}
+			cached = results.emplace(string(placeholder), make_tuple(move(value), mode)).first;
 		}
-	}
 
-	for (const auto& [placeholder, var_val] : results) {
-		result = Utils::replace(result, placeholder, var_val.value);
+		result.append(text, copied, pos - copied);
+		auto& [value, mode] = cached->second;
+		Escaper::append(result, value.value, mode);
+		pos = inner_end + 2;
+		copied = pos;
 	}
+	result.append(text, copied, string_view::npos);
 
 	return result;
 }
 
-std::vector<std::string> Core::split_statements(const std::string& input)
+/// <summary>
+/// Find the position of a trailing escape filter like "|html" in a placeholder.
+/// Only a top level '|' (outside quotes and parentheses) followed by a known mode counts.
+/// </summary>
+/// <param name="inner"></param>
+/// <returns></returns>
+size_t Core::find_escape_filter(const std::string& inner)
+{
+	size_t filter_pos = string::npos;
+	bool in_quotes = false;
+	int paren_depth = 0;
+	for (size_t i = 0; i < inner.size(); ++i) {
+		char c = inner[i];
+		if (c == '"' && (i == 0 || inner[i - 1] != '\\')) in_quotes = !in_quotes;
+		else if (in_quotes) continue;
+		else if (c == '(') paren_depth++;
+		else if (c == ')') paren_depth--;
+		else if (c == '|' && paren_depth == 0) filter_pos = i;
+	}
+
+	EscapeMode mode;
+	if (filter_pos == string::npos || !Escaper::parse_mode(Utils::trim_view(string_view(inner).substr(filter_pos + 1)), mode)) {
+		return string::npos;
+	}
+	return filter_pos;
+}
+
+std::vector<std::string> Core::split_statements(const std::string& input, std::vector<size_t>* offsets)
 {
 	vector<string> result;
 	string current;
@@ -437,10 +611,14 @@ std::vector<std::string> Core::split_statements(const std::string& input)
 
 	char quote_char = '\0';
 	bool in_quotes = false;
+	size_t start = string::npos;
 
 	for (size_t i = 0; i < input.length(); ++i) {
 		char c = input[i];
 		current.push_back(c);
+		if (offsets && start == string::npos && !isspace(static_cast<unsigned char>(c))) {
+			start = i; // First byte of the statement
+		}
 
 		if ((c == '"' || c == '\'') && (quote_char == '\0' || quote_char == c)) {
 			quote_char = (quote_char == '\0') ? c : '\0';
@@ -463,16 +641,21 @@ std::vector<std::string> Core::split_statements(const std::string& input)
 			if (brace_level == 0 && paren_level == 0) {
 				result.push_back(Utils::trim(current));
 				current.clear();
+				if (offsets) offsets->push_back(start);
+				start = string::npos;
 			}
 		}
 		else if (c == ';' && brace_level == 0 && paren_level == 0) {
 			result.push_back(Utils::trim(current));
 			current.clear();
+			if (offsets) offsets->push_back(start);
+			start = string::npos;
 		}
 	}
 
 	if (!current.empty()) {
 		result.push_back(Utils::trim(current));
+		if (offsets) offsets->push_back(start == string::npos ? input.size() : start);
 	}
 
 	return result;
@@ -514,15 +697,32 @@ std::string Core::extract_code_section(const std::string& input)
 	return result;
 }
 
-std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<std::string>& statements)
+std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<std::string>& statements, const std::vector<size_t>* lines)
 {
+	ProfileScope profile(PS_PARSE_AST);
 	vector<unique_ptr<ASTNode>> nodes;
 	bool in_if = false;
 	
 	auto if_node = std::make_unique<IfStatementNode>();
 
+	// Name nodes after their statement for the template profiler
+	bool label_nodes = TemplateProfiler::enabled();
+	const string* current_stmt = nullptr;
+	auto labelled = [&](auto node) {
+		if (label_nodes) {
+			node->profile_frame = TemplateProfiler::frame_label(*current_stmt);
+			node->profile_line = TemplateProfiler::current_line();
+		}
+		return node;
+	};
+
 	// Parse each statement for variable declarations
-	for (const auto& stmt : statements) {
+	for (size_t i = 0; i < statements.size(); ++i) {
+		const auto& stmt = statements[i];
+		current_stmt = &stmt;
+		if (lines && i < lines->size()) {
+			TemplateProfiler::set_line((*lines)[i]);
+		}
 		auto line = Utils::trim(stmt);
 
 		if (Utils::starts_with(line, "@var")) {
@@ -532,7 +732,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 			}
 			line = Vars::trim_var(line);
 			auto [key, value] = Vars::parse_var(line);
-			auto node = std::make_unique<VarDeclNode>(key, value);
+			auto node = labelled(std::make_unique<VarDeclNode>(key, value));
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@print")) {
@@ -541,7 +741,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 				in_if = false;
 			}
 			auto condition = Utils::parse_parantheses(line);
-			auto node = std::make_unique<TextNode>(condition);
+			auto node = labelled(std::make_unique<TextNode>(condition));
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@while")) {
@@ -551,7 +751,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 			}
 			auto condition = Utils::parse_parantheses(line);
 			auto body = Core::extract_code_section(line);
-			auto node = std::make_unique<WhileNode>(condition, body);
+			auto node = labelled(std::make_unique<WhileNode>(condition, body));
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@foreach")) {
@@ -561,7 +761,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 			}
 			auto condition = Utils::parse_parantheses(line);
 			auto body = Core::extract_code_section(line);
-			auto node = std::make_unique<ForEachNode>(condition, body);
+			auto node = labelled(std::make_unique<ForEachNode>(condition, body));
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@for")) {
@@ -571,7 +771,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 			}
 			auto condition = Utils::parse_parantheses(line);
 			auto body = Core::extract_code_section(line);
-			auto node = std::make_unique<ForNode>(condition, body);
+			auto node = labelled(std::make_unique<ForNode>(condition, body));
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@if")) {
@@ -580,7 +780,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 				in_if = false;
 			}
 			in_if = true;
-			if_node = std::make_unique<IfStatementNode>();
+			if_node = labelled(std::make_unique<IfStatementNode>());
 			if_node->add_branch(Utils::parse_parantheses(line), Core::extract_code_section(line));
 		}
 		else if (Utils::starts_with(line, "@else if"))
@@ -607,7 +807,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 				nodes.push_back(std::move(if_node));
 				in_if = false;
 			}
-			auto node = std::make_unique<BreakNode>();
+			auto node = labelled(std::make_unique<BreakNode>());
 			nodes.push_back(std::move(node));
 		}
 		else if (Utils::starts_with(line, "@continue")) {
@@ -615,7 +815,7 @@ std::vector<unique_ptr<ASTNode>> Core::parse_ast_statements(const std::vector<st
 				nodes.push_back(std::move(if_node));
 				in_if = false;
 			}
-			auto node = std::make_unique<ContinueNode>();
+			auto node = labelled(std::make_unique<ContinueNode>());
 			nodes.push_back(std::move(node));
 		}
 	}
@@ -4,12 +4,15 @@
 #include <map>
 #include "Vars.h"
 #include "ASTNode.h"
+#include "Minifier.h"
+#include "Escaper.h"
 #include <memory>
 
 struct XtmlTag {
 	std::string full;
 	std::string head;
 	std::string content;
+	size_t offset = 0; // Position of full in the scanned content
 	bool self_closing = false;
 	std::map<std::string, std::string> attributes;
 };
@@ -17,24 +20,29 @@ struct XtmlTag {
 class Core
 {
 public:
+	static MinifyOptions minify_options; // Output cleanup applied by clean_content
+
 	static std::vector<std::string> parse_blocks(const std::string& content, const std::string& start_tag, const std::string& end_tag);
-	static std::map<std::string, var> parse_block(const std::string& content, std::map<std::string, var>& vars);
-	static std::string resolve_include(const std::string& include_path, std::map<std::string, var>& vars, XtmlTag tag, bool resolve_global = true);
+	static VarMap parse_block(const std::string& content, VarMap& vars);
+	static std::string resolve_include(const std::string& include_path, VarMap& vars, XtmlTag tag, bool resolve_global = true);
 	static std::string remove_blocks(const std::string& content, const std::string& start_tag, const std::string& end_tag);
 	static std::string clean_content(std::string& content);	
-	static std::string build_file(const std::string& path, std::map<std::string, var>& vars);
-	static std::string build_content(std::string& content, std::string base_path, std::map<std::string, var>& vars);
+	static std::string build_file(const std::string& path, VarMap& vars);
+	static std::string build_content(std::string& content, std::string base_path, VarMap& vars);
+	static std::string finish_content(std::string& content, const VarMap& vars, EscapeMode escape_mode);
+	static var load_data(const std::string& path);
 	static void write_file(const std::string& content, const std::string& output_path);
 	static std::vector<XtmlTag> find_xtml_tags(const std::string& content);
 	static std::map<std::string, std::string> parse_xtml_attributes(const std::string& tag);
-	static std::map<std::string, var> params_to_vars(const std::map<std::string, std::string>& params);
+	static VarMap params_to_vars(const std::map<std::string, std::string>& params);
 	static std::vector<std::string> find_unresolved_vars(const std::string& content);
 	static std::tuple<std::string, var> resolve_self_closing_var(XtmlTag tag);
-	static std::string resolve_placeholders(const std::string& content, const std::map<std::string, var>& vars);
-	static std::vector<std::string> split_statements(const std::string& input);
+	static std::string resolve_placeholders(const std::string& content, const VarMap& vars, EscapeMode escape_mode = ESC_RAW);
+	static size_t find_escape_filter(const std::string& inner);
+	static std::vector<std::string> split_statements(const std::string& input, std::vector<size_t>* offsets = nullptr);
 	static std::string extract_code_section(const std::string& input);
 
 
-	static std::vector<std::unique_ptr<ASTNode>> parse_ast_statements(const std::vector<std::string>& statements);
+	static std::vector<std::unique_ptr<ASTNode>> parse_ast_statements(const std::vector<std::string>& statements, const std::vector<size_t>* lines = nullptr);
 };
 
@@ -0,0 +1,184 @@
+#include "Csv.h"
+#include "Scanner.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace {
+	/// <summary>
+	/// A row whose fields are decoded on first access and then kept
+	/// </summary>
+	class CsvRow : public VarObject
+	{
+	private:
+		shared_ptr<const CsvTable> m_table;
+		size_t m_row;
+		mutable VarMap m_decoded;
+	public:
+		CsvRow(shared_ptr<const CsvTable> table, size_t row) : m_table(move(table)), m_row(row) {}
+
+		const var* field(string_view name) const override {
+			if (auto it = m_decoded.find(name); it != m_decoded.end()) {
+				return &it->second;
+			}
+			size_t column = m_table->column(name);
+			if (column == SIZE_MAX) return nullptr;
+			return &m_decoded.emplace(string(name), m_table->field(m_row, column)).first->second;
+		}
+
+		size_t size() const override { return m_table->columns().size(); }
+	};
+
+	class CsvIterator : public VarIterator
+	{
+	private:
+		shared_ptr<const CsvTable> m_table;
+		size_t m_row = 0;
+	public:
+		CsvIterator(shared_ptr<const CsvTable> table) : m_table(move(table)) {}
+
+		bool next(var& out) override {
+			if (m_row >= m_table->row_count()) return false;
+			out = var{ "", DT_OBJECT };
+			out.object = make_shared<CsvRow>(m_table, m_row++);
+			return true;
+		}
+	};
+
+	// Decode the field starting at pos and move pos past its separator
+	string decode_field(string_view line, size_t& pos)
+	{
+		string value;
+		if (pos < line.size() && line[pos] == '"') {
+			pos++;
+			while (pos < line.size()) {
+				size_t quote = line.find('"', pos);
+				if (quote == string_view::npos) {
+					value.append(line, pos);
+					pos = line.size();
+					break;
+				}
+				value.append(line, pos, quote - pos);
+				pos = quote + 1;
+				if (pos < line.size() && line[pos] == '"') {
+					value += '"'; // Escaped quote
+					pos++;
+					continue;
+				}
+				break;
+			}
+			size_t comma = line.find(',', pos);
+			pos = comma == string_view::npos ? line.size() + 1 : comma + 1;
+			return value;
+		}
+		size_t comma = line.find(',', pos);
+		size_t end = comma == string_view::npos ? line.size() : comma;
+		value.assign(line, pos, end - pos);
+		pos = end + 1;
+		return value;
+	}
+
+	// Skip one field without decoding it
+	void skip_field(string_view line, size_t& pos)
+	{
+		bool in_quotes = false;
+		for (; pos < line.size(); ++pos) {
+			char c = line[pos];
+			if (c == '"') in_quotes = !in_quotes;
+			else if (c == ',' && !in_quotes) break;
+		}
+		pos++;
+	}
+
+	string_view strip_line_end(string_view line)
+	{
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.remove_suffix(1);
+		return line;
+	}
+}
+
+CsvTable::CsvTable(const string& path) : m_file(path)
+{
+	string_view text = m_file.view();
+	size_t header_end = text.find('\n');
+	m_columns = split_row(strip_line_end(text.substr(0, header_end)));
+	for (size_t i = 0; i < m_columns.size(); ++i) {
+		m_column_index.emplace(Utils::trim(m_columns[i]), i);
+	}
+	index_rows();
+}
+
+void CsvTable::index_rows()
+{
+	// One pass over the file: jump between quotes and newlines, a newline inside quotes belongs to the field
+	string_view text = m_file.view();
+	size_t pos = text.find('\n');
+	if (pos == string_view::npos) return;
+	pos++;
+
+	size_t row_start = pos;
+	bool in_quotes = false;
+	while ((pos = Scanner::find_first_of(text, "\"\n", pos)) != Scanner::npos) {
+		if (text[pos] == '"') {
+			in_quotes = !in_quotes;
+		}
+		else if (!in_quotes) {
+			if (!strip_line_end(text.substr(row_start, pos - row_start)).empty()) {
+				m_rows.push_back(row_start);
+			}
+			row_start = pos + 1;
+		}
+		pos++;
+	}
+	if (row_start < text.size() && !strip_line_end(text.substr(row_start)).empty()) {
+		m_rows.push_back(row_start);
+	}
+	if (!m_rows.empty()) {
+		m_rows.push_back(text.size());
+	}
+}
+
+size_t CsvTable::column(string_view name) const
+{
+	auto it = m_column_index.find(name);
+	return it == m_column_index.end() ? SIZE_MAX : it->second;
+}
+
+var CsvTable::field(size_t row, size_t column) const
+{
+	string_view text = m_file.view();
+	string_view line = strip_line_end(text.substr(m_rows[row], m_rows[row + 1] - m_rows[row]));
+
+	// Only the fields before the requested one are scanned, the rest of the row is not touched
+	size_t pos = 0;
+	for (size_t i = 0; i < column && pos <= line.size(); ++i) {
+		skip_field(line, pos);
+	}
+	if (pos > line.size()) {
+		return var{ "", DT_STRING }; // Short row
+	}
+	auto value = decode_field(line, pos);
+	bool is_number = Utils::is_number(value) && value.size() <= 18;
+	return var{ move(value), is_number ? DT_NUMBER : DT_STRING };
+}
+
+vector<string> CsvTable::split_row(string_view line)
+{
+	vector<string> fields;
+	size_t pos = 0;
+	while (pos <= line.size()) {
+		fields.push_back(decode_field(line, pos));
+	}
+	return fields;
+}
+
+unique_ptr<VarIterator> CsvIterable::iterate() const
+{
+	return make_unique<CsvIterator>(m_table);
+}
+
+var Csv::load_file(const string& path)
+{
+	auto table = make_shared<const CsvTable>(path);
+	return var{ "", DT_ITERABLE, {}, make_shared<CsvIterable>(table) };
+}
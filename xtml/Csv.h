@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include "Vars.h"
+#include "Iterable.h"
+#include "MappedFile.h"
+
+/// <summary>
+/// Memory-mapped CSV file (RFC 4180, comma separated, first row is the header).
+/// Row offsets are indexed once when the file is opened; fields are decoded
+/// only when a template reads them.
+/// </summary>
+class CsvTable
+{
+private:
+	MappedFile m_file;
+	std::vector<std::string> m_columns;
+	std::map<std::string, size_t, std::less<>> m_column_index;
+	std::vector<size_t> m_rows; // Start offset of each data row, plus the end of the last one
+
+	void index_rows();
+public:
+	explicit CsvTable(const std::string& path);
+
+	size_t row_count() const { return m_rows.empty() ? 0 : m_rows.size() - 1; }
+	const std::vector<std::string>& columns() const { return m_columns; }
+	// Column number of a header name, or SIZE_MAX
+	size_t column(std::string_view name) const;
+	// Decode a single field of a row
+	var field(size_t row, size_t column) const;
+
+	static std::vector<std::string> split_row(std::string_view line);
+};
+
+/// <summary>
+/// Rows of a CsvTable as DT_OBJECT records, e.g. <xtml data="products.csv" as="rows" />
+/// </summary>
+class CsvIterable : public VarIterable
+{
+private:
+	std::shared_ptr<const CsvTable> m_table;
+public:
+	explicit CsvIterable(std::shared_ptr<const CsvTable> table) : m_table(std::move(table)) {}
+	std::unique_ptr<VarIterator> iterate() const override;
+	size_t size() const override { return m_table->row_count(); }
+};
+
+class Csv
+{
+public:
+	static var load_file(const std::string& path);
+};
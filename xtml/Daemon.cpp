@@ -0,0 +1,381 @@
+#include "Daemon.h"
+#include "Utils.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+namespace {
+	// Wire format: the argument count on its own line, then every argument as its byte
+	// length on its own line followed by the raw bytes, so arguments may be empty or
+	// contain newlines. The reply is "ok" or "error" on the first line followed by the
+	// message, up to the end of the stream.
+	const size_t MAX_ARGUMENTS = 4096;
+	const size_t MAX_REQUEST_BYTES = 1 << 20;
+	// A client has this long to send its request and to take its reply
+	const int REQUEST_TIMEOUT_MS = 5000;
+	// Connections served at once, each on its own thread; more are turned away
+	const size_t MAX_CONNECTIONS = 64;
+
+	bool write_all(int fd, const string& data)
+	{
+		size_t written = 0;
+		while (written < data.size()) {
+			auto n = ::write(fd, data.data() + written, data.size() - written);
+			if (n <= 0) return false;
+			written += static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	string read_all(int fd)
+	{
+		string data;
+		char buffer[4096];
+		while (true) {
+			auto n = ::read(fd, buffer, sizeof(buffer));
+			if (n <= 0) break;
+			data.append(buffer, static_cast<size_t>(n));
+		}
+		return data;
+	}
+
+	string encode_request(const vector<string>& args)
+	{
+		string request = to_string(args.size()) + "\n";
+		for (auto& arg : args) {
+			request += to_string(arg.size()) + "\n";
+			request += arg;
+		}
+		return request;
+	}
+
+	/// <summary>
+	/// Reads one request from a client, giving up when the deadline passes or a limit is exceeded
+	/// </summary>
+	class RequestReader
+	{
+	public:
+		explicit RequestReader(int fd)
+			: m_fd(fd), m_deadline(chrono::steady_clock::now() + chrono::milliseconds(REQUEST_TIMEOUT_MS)) {}
+
+		bool read(vector<string>& args)
+		{
+			size_t count;
+			if (!read_size(count) || count > MAX_ARGUMENTS) return false;
+			size_t total = 0;
+			for (size_t i = 0; i < count; ++i) {
+				size_t length;
+				if (!read_size(length)) return false;
+				total += length;
+				if (total > MAX_REQUEST_BYTES || !fill_to(m_pos + length)) return false;
+				args.push_back(m_data.substr(m_pos, length));
+				m_pos += length;
+			}
+			return true;
+		}
+
+	private:
+		int m_fd;
+		chrono::steady_clock::time_point m_deadline;
+		string m_data;
+		size_t m_pos = 0;
+
+		bool fill()
+		{
+			auto remaining = chrono::duration_cast<chrono::milliseconds>(m_deadline - chrono::steady_clock::now()).count();
+			if (remaining <= 0) return false;
+			pollfd poll_fd = { m_fd, POLLIN, 0 };
+			if (poll(&poll_fd, 1, static_cast<int>(remaining)) <= 0) return false;
+			char buffer[4096];
+			auto n = ::read(m_fd, buffer, sizeof(buffer));
+			if (n <= 0) return false;
+			m_data.append(buffer, static_cast<size_t>(n));
+			return true;
+		}
+
+		bool fill_to(size_t size)
+		{
+			while (m_data.size() < size) {
+				if (!fill()) return false;
+			}
+			return true;
+		}
+
+		bool read_size(size_t& value)
+		{
+			size_t end;
+			while ((end = m_data.find('\n', m_pos)) == string::npos) {
+				if (m_data.size() - m_pos > 9 || !fill()) return false;
+			}
+			auto digits = m_data.substr(m_pos, end - m_pos);
+			if (digits.empty() || digits.size() > 9 || digits.find_first_not_of("0123456789") != string::npos) return false;
+			value = stoul(digits);
+			m_pos = end + 1;
+			return true;
+		}
+	};
+
+	bool make_address(const string& path, sockaddr_un& address)
+	{
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path)) return false;
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+
+	int connect_to(const string& path)
+	{
+		sockaddr_un address;
+		if (!make_address(path, address)) return -1;
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) return -1;
+		if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	// Only the user running the daemon may talk to it, in both directions
+	bool peer_is_same_user(int fd)
+	{
+#ifdef SO_PEERCRED
+		ucred credentials;
+		socklen_t length = sizeof(credentials);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) return false;
+		return credentials.uid == geteuid();
+#else
+		uid_t uid;
+		gid_t gid;
+		if (getpeereid(fd, &uid, &gid) != 0) return false;
+		return uid == geteuid();
+#endif
+	}
+
+	string default_directory()
+	{
+		if (const char* runtime_dir = getenv("XDG_RUNTIME_DIR"); runtime_dir && *runtime_dir) {
+			return string(runtime_dir) + "/xtml";
+		}
+		return "/tmp/xtml-" + to_string(geteuid());
+	}
+
+	/// <summary>
+	/// Create the socket directory, or check that an existing one is a real directory owned by
+	/// this user and closed to everyone else, so nobody can plant or swap the socket
+	/// </summary>
+	bool make_private_directory(const string& directory)
+	{
+		if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+			Utils::printerr_ln("Error: Could not create " + directory + ": " + strerror(errno));
+			return false;
+		}
+		struct stat info;
+		if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() || (info.st_mode & 077) != 0) {
+			Utils::printerr_ln("Error: Socket directory is not private to this user: " + directory);
+			return false;
+		}
+		return true;
+	}
+}
+#endif
+
+bool Daemon::is_supported()
+{
+#ifndef _WIN32
+	return true;
+#else
+	return false;
+#endif
+}
+
+string Daemon::socket_path()
+{
+	if (const char* path = getenv("XTML_SOCKET"); path && *path) {
+		return path;
+	}
+#ifndef _WIN32
+	return default_directory() + "/daemon.sock";
+#else
+	return "";
+#endif
+}
+
+int Daemon::serve(const string& path, const Handler& handler)
+{
+#ifndef _WIN32
+	sockaddr_un address;
+	if (!make_address(path, address)) {
+		Utils::printerr_ln("Error: Socket path too long: " + path);
+		return 1;
+	}
+	auto directory = path.substr(0, path.rfind('/'));
+	if (directory == default_directory() && !make_private_directory(directory)) {
+		return 1;
+	}
+
+	// Refuse to start twice, but clean up a socket left behind by a crashed daemon
+	if (int fd = connect_to(path); fd >= 0) {
+		close(fd);
+		Utils::printerr_ln("Error: A daemon is already listening on " + path);
+		return 1;
+	}
+	unlink(path.c_str());
+
+	// The socket is never accessible to other users, not even between bind and chmod
+	int server = socket(AF_UNIX, SOCK_STREAM, 0);
+	auto old_mask = umask(077);
+	bool bound = server >= 0 && bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+	umask(old_mask);
+	if (!bound || chmod(path.c_str(), 0600) != 0 || listen(server, 64) != 0) {
+		Utils::printerr_ln("Error: Could not listen on " + path + ": " + strerror(errno));
+		if (server >= 0) close(server);
+		return 1;
+	}
+	Utils::print_ln("xtml daemon listening on " + path);
+	// A client that disconnects early must not take the daemon down with it
+	signal(SIGPIPE, SIG_IGN);
+
+	// A stop request wakes the accept loop through this pipe
+	int wake[2];
+	if (pipe(wake) != 0) {
+		Utils::printerr_ln(string("Error: Could not create pipe: ") + strerror(errno));
+		close(server);
+		unlink(path.c_str());
+		return 1;
+	}
+
+	mutex workers_mutex;
+	condition_variable workers_done;
+	size_t active = 0;
+	atomic<bool> running = true;
+
+	// Each connection gets its own thread, so a slow client or a long build does not hold up the others
+	auto serve_client = [&](int client) {
+		vector<string> args;
+		Reply reply;
+		if (!RequestReader(client).read(args)) {
+			reply.ok = false;
+			reply.message = "Error: Malformed or incomplete daemon request.";
+		}
+		else if (args.size() == 1 && args[0] == "stop") {
+			reply.message = "Daemon stopped.";
+			running = false;
+			write_all(wake[1], "x");
+		}
+		else {
+			try {
+				reply = handler(args);
+			}
+			catch (const exception& e) {
+				reply.ok = false;
+				reply.message = e.what();
+			}
+		}
+		write_all(client, (reply.ok ? "ok\n" : "error\n") + reply.message);
+		close(client);
+
+		lock_guard<mutex> lock(workers_mutex);
+		--active;
+		workers_done.notify_all();
+	};
+
+	while (running) {
+		pollfd poll_fds[2] = { { server, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+		if (poll(poll_fds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (poll_fds[1].revents != 0) {
+			break;
+		}
+		int client = accept(server, nullptr, nullptr);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		if (!peer_is_same_user(client)) {
+			close(client);
+			continue;
+		}
+		// A client that stops reading its reply must not stall its worker either
+		timeval send_timeout = { REQUEST_TIMEOUT_MS / 1000, 0 };
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+		{
+			lock_guard<mutex> lock(workers_mutex);
+			if (active < MAX_CONNECTIONS) {
+				++active;
+				thread(serve_client, client).detach();
+				continue;
+			}
+		}
+		write_all(client, "error\nError: The daemon is busy, try again later.");
+		close(client);
+	}
+
+	// No new connections, but requests in progress still get their reply
+	close(server);
+	unlink(path.c_str());
+	{
+		unique_lock<mutex> lock(workers_mutex);
+		workers_done.wait(lock, [&] { return active == 0; });
+	}
+	close(wake[0]);
+	close(wake[1]);
+	return 0;
+#else
+	Utils::printerr_ln("Error: The build daemon is not supported on this platform.");
+	return 1;
+#endif
+}
+
+bool Daemon::send(const string& path, const vector<string>& args, Reply& reply)
+{
+#ifndef _WIN32
+	int fd = connect_to(path);
+	if (fd < 0) return false;
+	if (!peer_is_same_user(fd)) {
+		Utils::printerr_ln("Error: The daemon on " + path + " belongs to another user, ignoring it.");
+		close(fd);
+		return false;
+	}
+
+	if (!write_all(fd, encode_request(args))) {
+		close(fd);
+		return false;
+	}
+	shutdown(fd, SHUT_WR);
+
+	auto response = read_all(fd);
+	close(fd);
+
+	auto status_end = response.find('\n');
+	auto status = response.substr(0, status_end);
+	if (status != "ok" && status != "error") return false;
+	reply.ok = status == "ok";
+	reply.message = status_end == string::npos ? "" : response.substr(status_end + 1);
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+/// <summary>
+/// Resident build server over a local Unix domain socket. A request is a list of
+/// arguments, the reply is a status ("ok" or "error") and a message. Only the user
+/// running the daemon can connect to it. Each connection is served on its own thread,
+/// so the handler is called concurrently. Only available on POSIX systems.
+/// </summary>
+class Daemon
+{
+public:
+	struct Reply {
+		bool ok = true;
+		std::string message;
+	};
+	typedef std::function<Reply(const std::vector<std::string>& args)> Handler;
+
+	static bool is_supported();
+	static std::string socket_path();
+	// Serve requests until a "stop" request arrives. Returns the process exit code.
+	static int serve(const std::string& path, const Handler& handler);
+	// Send a request to a running daemon. Returns false if no daemon is listening.
+	static bool send(const std::string& path, const std::vector<std::string>& args, Reply& reply);
+};
@@ -0,0 +1,484 @@
+#include "Engine.h"
+#include "Core.h"
+#include "Utils.h"
+#include "ModuleStd.h"
+#include "Tracer.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "TemplateProfiler.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace xtml {
+
+	enum BlockKind {
+		BK_CODE,
+		BK_INCLUDE, // <xtml include="..." />
+		BK_DATA, // <xtml data="..." as="..." />
+		BK_DEFINE // <xtml define="..." value="..." />
+	};
+
+	struct CompiledBlock {
+		XtmlTag tag;
+		BlockKind kind = BK_CODE;
+		std::string path; // Include or data file, joined with the template's base path
+		bool resolve_global = true; // Include merges its variables back
+		size_t first = 0; // First block with the same text, whose output replaces this one
+		size_t line = 0; // Template profiler only
+		std::shared_ptr<BlockNode> node; // Parsed statements, not modified by evaluation
+		std::string error; // Parse error, raised when rendering reaches the block
+	};
+
+	/// <summary>
+	/// Find the xtml tags of source and parse their statements once; rendering only evaluates them.
+	/// </summary>
+	/// <param name="name"></param>
+	/// <param name="source"></param>
+	/// <param name="base_path"></param>
+	Template::Template(string name, string source, string base_path)
+		: m_name(std::move(name)), m_source(std::move(source)), m_base_path(std::move(base_path))
+	{
+		// Errors are logged when a render reaches the block, as Core::build_content does
+		LogFunc silent = [](LogLevel, const string&) {};
+		RenderContext context = RenderContext::current();
+		context.log = &silent;
+		RenderScope scope(context);
+		TemplateFileScope profile_file(m_name);
+
+		auto tags = Core::find_xtml_tags(m_source);
+		unordered_map<string_view, size_t> first_index;
+		for (size_t i = 0; i < tags.size(); ++i) {
+			first_index.emplace(tags[i].full, i);
+		}
+
+		size_t line = 1;
+		size_t counted = 0;
+		m_blocks.reserve(tags.size());
+		for (size_t i = 0; i < tags.size(); ++i) {
+			CompiledBlock block;
+			const auto& tag = tags[i];
+			block.first = first_index.at(tag.full);
+			line += std::count(m_source.begin() + counted, m_source.begin() + tag.offset, '\n');
+			counted = tag.offset;
+			block.line = line;
+
+			auto has = [&tag](const char* attribute) { return tag.attributes.find(attribute) != tag.attributes.end(); };
+			if (tag.self_closing && has("include")) {
+				block.kind = BK_INCLUDE;
+				block.path = Utils::join_path(m_base_path, Utils::trim(tag.attributes.at("include")));
+				block.resolve_global = !has("resolve") || Utils::trim(tag.attributes.at("resolve")) != "local";
+			}
+			else if (tag.self_closing && has("data")) {
+				block.kind = BK_DATA;
+				block.path = Utils::join_path(m_base_path, Utils::trim(tag.attributes.at("data")));
+			}
+			else if (tag.self_closing && has("define")) {
+				block.kind = BK_DEFINE;
+			}
+
+			try {
+				auto statements = Core::split_statements(Vars::preprocess_content(tag.content));
+				vector<size_t> statement_lines;
+				block.node = make_shared<BlockNode>();
+				if (TemplateProfiler::enabled()) {
+					// Preprocessing only drops whitespace, so splitting the raw block yields the same statements with their lines
+					size_t head_line = line + std::count(tag.head.begin(), tag.head.end(), '\n');
+					TemplateProfiler::set_line(head_line);
+					block.node->profile_frame = TemplateProfiler::frame_label("<xtml>");
+					block.node->profile_line = head_line;
+					vector<size_t> offsets;
+					Core::split_statements(tag.content, &offsets);
+					size_t statement_line = head_line;
+					size_t statement_counted = 0;
+					for (size_t offset : offsets) {
+						statement_line += std::count(tag.content.begin() + statement_counted, tag.content.begin() + offset, '\n');
+						statement_counted = offset;
+						statement_lines.push_back(statement_line);
+					}
+					if (statement_lines.size() < statements.size()) {
+						statement_lines.clear();
+					}
+				}
+				for (auto& child : Core::parse_ast_statements(statements, statement_lines.empty() ? nullptr : &statement_lines)) {
+					block.node->add_child(move(child));
+				}
+			}
+			catch (const exception& e) {
+				block.node.reset();
+				block.error = e.what();
+			}
+			m_blocks.push_back(std::move(block));
+		}
+		for (size_t i = 0; i < tags.size(); ++i) {
+			m_blocks[i].tag = std::move(tags[i]);
+		}
+	}
+
+	Template::~Template() = default;
+
+	Engine::Engine(bool register_std)
+	{
+		if (register_std) {
+			ModuleStd stdModule;
+			stdModule.RegisterFunctions(m_registry);
+		}
+	}
+
+	RenderContext Engine::context(const RenderOptions& options) const
+	{
+		RenderContext context;
+		context.registry = const_cast<FunctionRegistry*>(&m_registry); // Lookups only during rendering
+		context.registry->Freeze(); // Registration ends with the first compile or render
+		context.minify_options = options.minify_options ? options.minify_options : &m_minify_options;
+		context.budget_limits = options.budget_limits ? options.budget_limits : &m_budget_limits;
+		context.log = options.log ? options.log : m_log ? &m_log : nullptr;
+		return context;
+	}
+
+	/// <summary>
+	/// Load and compile a template file. Templates are cached by path and recompiled when the file changes.
+	/// </summary>
+	/// <param name="path"></param>
+	/// <returns></returns>
+	TemplatePtr Engine::compile(const string& path) const
+	{
+		RenderScope scope(context());
+		return load(path);
+	}
+
+	/// <summary>
+	/// compile() under the current render context, for includes met while rendering
+	/// </summary>
+	/// <param name="path"></param>
+	/// <returns></returns>
+	TemplatePtr Engine::load(const string& path) const
+	{
+		error_code ec;
+		auto modified = fs::last_write_time(path, ec);
+		{
+			shared_lock<shared_mutex> lock(m_cache_mutex);
+			auto it = m_cache.find(path);
+			if (it != m_cache.end() && !ec && it->second->m_modified == modified) {
+				return it->second;
+			}
+		}
+
+		auto tpl = make_shared<Template>(path, Utils::read_file(path), Utils::file_path_parent(path));
+		tpl->m_modified = modified;
+
+		unique_lock<shared_mutex> lock(m_cache_mutex);
+		m_cache[path] = tpl;
+		return tpl;
+	}
+
+	/// <summary>
+	/// Compile a template from a string. Includes are resolved against base_path. Not cached.
+	/// </summary>
+	/// <param name="source"></param>
+	/// <param name="base_path"></param>
+	/// <param name="name"></param>
+	/// <returns></returns>
+	TemplatePtr Engine::compile_string(const string& source, const string& base_path, const string& name) const
+	{
+		RenderScope scope(context());
+		return make_shared<Template>(name, source, base_path);
+	}
+
+	void Engine::clear_cache()
+	{
+		unique_lock<shared_mutex> lock(m_cache_mutex);
+		m_cache.clear();
+	}
+
+	/// <summary>
+	/// Render a template with the given variables and pass the output to sink.
+	/// The caller's variables are not modified.
+	/// </summary>
+	/// <param name="tpl"></param>
+	/// <param name="vars"></param>
+	/// <param name="sink"></param>
+	/// <param name="options"></param>
+	void Engine::render(const Template& tpl, const VarMap& vars, const Sink& sink, const RenderOptions& options) const
+	{
+		TraceSpan trace("render", Tracer::enabled() ? "render " + tpl.name() : string());
+		RenderScope scope(context(options));
+		FunctionRegistry::ReadScope functions; // One for the whole render, the ones around each call are nested
+		BudgetScope budget(tpl.name());
+		VarMap local_vars = vars;
+		auto output = evaluate(tpl, local_vars);
+		sink(output);
+	}
+
+	string Engine::render(const Template& tpl, const VarMap& vars, const RenderOptions& options) const
+	{
+		string output;
+		render(tpl, vars, [&output](string_view chunk) { output.append(chunk); }, options);
+		return output;
+	}
+
+	/// <summary>
+	/// Evaluate the compiled blocks of a template in order and put their output in place of the tags.
+	/// Gives the same result as Core::build_content on the source, which replaces every occurrence
+	/// of a tag's text with the output of the first block having that text.
+	/// </summary>
+	/// <param name="tpl"></param>
+	/// <param name="vars">Receives self-closing definitions, like the vars of build_content</param>
+	/// <returns></returns>
+	string Engine::evaluate(const Template& tpl, VarMap& vars) const
+	{
+		// Function call frames take the file and line of the statement being evaluated
+		TemplateFileScope profile_file(tpl.name());
+		VarMap scope = vars;
+		EscapeMode escape_mode = ESC_RAW;
+		vector<string> outputs(tpl.m_blocks.size());
+
+		for (size_t i = 0; i < tpl.m_blocks.size(); ++i) {
+			const auto& block = tpl.m_blocks[i];
+			const auto& tag = block.tag;
+			if (TemplateProfiler::enabled()) {
+				TemplateProfiler::set_line(block.line);
+			}
+			if (tag.self_closing && tag.attributes.find("escape") != tag.attributes.end()) {
+				// Default escaping for the placeholders of this template e.g. <xtml escape="html" />
+				auto mode_name = Utils::trim(tag.attributes.at("escape"));
+				if (!Escaper::parse_mode(mode_name, escape_mode)) {
+					Utils::throw_err("Error: Unknown escape mode: " + mode_name);
+				}
+			}
+
+			string output;
+			if (block.kind == BK_INCLUDE) {
+				output = evaluate_include(block, scope);
+			}
+			else if (block.kind == BK_DATA) {
+				auto as_it = tag.attributes.find("as");
+				if (as_it == tag.attributes.end() || Utils::trim(as_it->second).empty()) {
+					Utils::throw_err("Error: Data tag requires an 'as' attribute: " + tag.full);
+				}
+				scope[Utils::trim(as_it->second)] = Core::load_data(block.path);
+			}
+			else if (block.kind == BK_DEFINE) {
+				auto [var_key, var_value] = Core::resolve_self_closing_var(tag);
+				vars[var_key] = var_value;
+			}
+
+			if (!block.error.empty()) {
+				Utils::throw_err(block.error);
+			}
+			EvalResult evaluated;
+			{
+				ProfileScope profile(PS_EVALUATE);
+				evaluated = block.node->run(scope);
+			}
+			if (block.kind == BK_CODE) {
+				output = std::move(evaluated.content);
+			}
+			if (block.first == i) {
+				outputs[i] = std::move(output);
+			}
+		}
+
+		string content;
+		content.reserve(tpl.m_source.size());
+		size_t pos = 0;
+		for (const auto& block : tpl.m_blocks) {
+			content.append(tpl.m_source, pos, block.tag.offset - pos);
+			content += outputs[block.first];
+			pos = block.tag.offset + block.tag.full.size();
+		}
+		content.append(tpl.m_source, pos, string::npos);
+
+		return Core::finish_content(content, scope, escape_mode);
+	}
+
+	/// <summary>
+	/// Render an include tag through the template cache, as Core::resolve_include does from the file
+	/// </summary>
+	/// <param name="block"></param>
+	/// <param name="vars"></param>
+	/// <returns></returns>
+	string Engine::evaluate_include(const CompiledBlock& block, VarMap& vars) const
+	{
+		const auto& include_path = block.path;
+		ProfileScope profile(PS_RESOLVE_INCLUDE);
+		TraceSpan trace("include", Tracer::enabled() ? "include " + include_path : string());
+		TemplateFrame profile_frame(TemplateProfiler::enabled() ? TemplateProfiler::frame_label("include " + Utils::file_name(include_path)) : string());
+		TemplateFileScope profile_file(include_path);
+		BudgetIncludeScope budget(include_path);
+		if (Logger::enabled(LL_DEBUG)) Utils::log(LL_DEBUG, "Resolving include: " + include_path);
+
+		VarMap local_vars;
+		if (block.resolve_global) {
+			local_vars.insert(vars.begin(), vars.end());
+		}
+		auto param_vars = Core::params_to_vars(block.tag.attributes);
+		for (auto& [k, v] : param_vars) {
+			v.value = Vars::replace_vars(v.value, vars);
+		}
+		local_vars = Vars::merge_vars(local_vars, param_vars);
+
+		auto tpl = load(include_path);
+		if (Logger::enabled(LL_TRACE)) Utils::log(LL_TRACE, "Processing include: " + include_path);
+		auto content = evaluate(*tpl, local_vars);
+
+		if (block.resolve_global) {
+			vars = Vars::merge_vars(vars, local_vars);
+		}
+		return content;
+	}
+
+	/// <summary>
+	/// Render one template against every variable set of source on a thread pool.
+	/// Results reach sink in input order; at most max_pending sets are held in memory.
+	/// </summary>
+	/// <param name="tpl"></param>
+	/// <param name="source"></param>
+	/// <param name="sink"></param>
+	/// <param name="options"></param>
+	/// <returns></returns>
+	BatchResult Engine::render_batch(const Template& tpl, const VarSource& source, const BatchSink& sink, const BatchOptions& options) const
+	{
+		struct Job {
+			VarMap vars;
+			optional<string> output; // Empty until rendered, or when rendering failed
+			bool done = false;
+		};
+
+		size_t threads = options.threads ? options.threads : max(1u, thread::hardware_concurrency());
+		size_t max_pending = options.max_pending ? options.max_pending : threads * 4;
+
+		mutex lock_mutex;
+		condition_variable window_cv;
+		map<size_t, Job> pending; // Pulled but not yet emitted, keyed by input index
+		size_t next_index = 0;
+		size_t next_emit = 0;
+		bool exhausted = false;
+		bool emitting = false;
+		bool stop = false;
+		BatchResult result;
+
+		// Runs with lock_mutex released. The sink gets the engine's render context, and
+		// a sink that throws fails its set instead of ending the process on a pool thread.
+		auto emit = [&](size_t index, const Job& job) -> optional<string> {
+			try {
+				RenderScope scope(context());
+				sink(index, job.vars, *job.output);
+			}
+			catch (const exception& e) {
+				return string(e.what());
+			}
+			return nullopt;
+		};
+		auto emitted = [&](size_t index, optional<string> error) {
+			if (error) {
+				result.errors.emplace_back(index, move(*error));
+				stop = stop || options.stop_on_error;
+			}
+			else {
+				result.rendered++;
+			}
+		};
+
+		auto worker = [&]() {
+			unique_lock<mutex> lock(lock_mutex);
+			while (true) {
+				window_cv.wait(lock, [&] { return stop || exhausted || next_index - next_emit < max_pending; });
+				if (stop || exhausted) {
+					return;
+				}
+
+				// Pull the next set while holding the lock, the source is not required to be thread-safe
+				VarMap vars;
+				bool has_next = false;
+				try {
+					has_next = source(vars);
+				}
+				catch (const exception& e) {
+					result.errors.emplace_back(next_index, e.what());
+					stop = true;
+				}
+				if (!has_next) {
+					exhausted = true;
+					window_cv.notify_all();
+					return;
+				}
+				size_t index = next_index++;
+				auto& job = pending[index];
+				job.vars = move(vars);
+
+				lock.unlock();
+				optional<string> output;
+				string error;
+				try {
+					output = render(tpl, job.vars);
+				}
+				catch (const exception& e) {
+					error = e.what();
+				}
+				lock.lock();
+
+				job.output = move(output);
+				job.done = true;
+				if (!job.output) {
+					result.errors.emplace_back(index, error);
+					stop = stop || options.stop_on_error;
+				}
+
+				// Emit finished results in order; only one thread emits at a time
+				if (emitting) {
+					continue;
+				}
+				emitting = true;
+				while (true) {
+					auto it = pending.find(next_emit);
+					if (it == pending.end() || !it->second.done) {
+						break;
+					}
+					auto ready = move(it->second);
+					pending.erase(it);
+					if (ready.output) {
+						lock.unlock();
+						auto error = emit(next_emit, ready);
+						lock.lock();
+						emitted(next_emit, move(error));
+					}
+					next_emit++;
+					window_cv.notify_all();
+				}
+				emitting = false;
+			}
+		};
+
+		vector<thread> pool;
+		for (size_t i = 1; i < threads; ++i) {
+			pool.emplace_back(worker);
+		}
+		worker();
+		for (auto& t : pool) {
+			t.join();
+		}
+
+		// Results that finished after the last emitter left (only possible when stopping early)
+		for (auto& [index, job] : pending) {
+			if (index != next_emit || !job.done) {
+				break;
+			}
+			if (job.output) {
+				emitted(index, emit(index, job));
+			}
+			next_emit++;
+		}
+
+		sort(result.errors.begin(), result.errors.end());
+		return result;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+#include <shared_mutex>
+#include <vector>
+#include "Vars.h"
+#include "FunctionRegistry.h"
+#include "Minifier.h"
+#include "RenderContext.h"
+#include "Budget.h"
+
+namespace xtml {
+
+	struct CompiledBlock; // Engine.cpp
+
+	/// <summary>
+	/// A compiled template: its source, the positions of its xtml tags with their parsed
+	/// statements, and the directory includes are resolved against.
+	/// Immutable once compiled, so one instance can be rendered from many threads.
+	/// </summary>
+	class Template
+	{
+	private:
+		std::string m_name;
+		std::string m_source;
+		std::string m_base_path;
+		std::filesystem::file_time_type m_modified {};
+		std::vector<CompiledBlock> m_blocks; // In source order
+
+		friend class Engine;
+	public:
+		Template(std::string name, std::string source, std::string base_path);
+		~Template();
+
+		const std::string& name() const { return m_name; }
+		const std::string& source() const { return m_source; }
+		const std::string& base_path() const { return m_base_path; }
+	};
+
+	typedef std::shared_ptr<const Template> TemplatePtr;
+	typedef std::function<void(std::string_view)> Sink;
+
+	// Fills vars with the next variable set, returns false when there are no more
+	typedef std::function<bool(VarMap& vars)> VarSource;
+	// Receives each result in input order, never from two threads at once, under the engine's
+	// render context. An exception fails that set and is reported in BatchResult::errors.
+	typedef std::function<void(size_t index, const VarMap& vars, std::string_view output)> BatchSink;
+
+	// Settings of a single render that replace the engine's, for callers that serve
+	// requests with different options from one engine. Unset fields keep the engine's.
+	struct RenderOptions {
+		const MinifyOptions* minify_options = nullptr;
+		const BudgetLimits* budget_limits = nullptr;
+		const LogFunc* log = nullptr;
+	};
+
+	struct BatchOptions {
+		size_t threads = 0; // 0: one per hardware thread
+		size_t max_pending = 0; // Rendered or in-flight sets held at most, 0: threads * 4
+		bool stop_on_error = false;
+	};
+
+	struct BatchResult {
+		size_t rendered = 0;
+		std::vector<std::pair<size_t, std::string>> errors; // Input index and message of sets that failed to render or to be written
+	};
+
+	/// <summary>
+	/// Embeddable renderer with its own function registry, template cache and logger.
+	/// Register functions and set options before rendering; the first compile or render
+	/// freezes the registry, after that both may be called concurrently from any number of threads.
+	/// </summary>
+	class Engine
+	{
+	private:
+		FunctionRegistry m_registry;
+		MinifyOptions m_minify_options;
+		BudgetLimits m_budget_limits;
+		LogFunc m_log;
+		mutable std::shared_mutex m_cache_mutex;
+		mutable std::unordered_map<std::string, TemplatePtr> m_cache; // Also filled by includes while rendering
+
+		RenderContext context(const RenderOptions& options = RenderOptions()) const;
+		TemplatePtr load(const std::string& path) const;
+		std::string evaluate(const Template& tpl, VarMap& vars) const;
+		std::string evaluate_include(const CompiledBlock& block, VarMap& vars) const;
+	public:
+		explicit Engine(bool register_std = true);
+
+		FunctionRegistry& registry() { return m_registry; }
+		void set_logger(LogFunc log) { m_log = std::move(log); }
+		void set_minify_options(const MinifyOptions& options) { m_minify_options = options; }
+		void set_budget_limits(const BudgetLimits& limits) { m_budget_limits = limits; } // Applied to each render separately
+
+		TemplatePtr compile(const std::string& path) const;
+		TemplatePtr compile_string(const std::string& source, const std::string& base_path = "", const std::string& name = "<string>") const;
+		void clear_cache();
+
+		void render(const Template& tpl, const VarMap& vars, const Sink& sink, const RenderOptions& options = RenderOptions()) const;
+		std::string render(const Template& tpl, const VarMap& vars, const RenderOptions& options = RenderOptions()) const;
+		BatchResult render_batch(const Template& tpl, const VarSource& source, const BatchSink& sink, const BatchOptions& options = BatchOptions()) const;
+	};
+}
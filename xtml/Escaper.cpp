@@ -0,0 +1,78 @@
+#include "Escaper.h"
+#include "Scanner.h"
+
+using namespace std;
+
+namespace {
+	const char* html_entity(char c)
+	{
+		switch (c) {
+		case '&': return "&amp;";
+		case '<': return "&lt;";
+		case '>': return "&gt;";
+		case '"': return "&quot;";
+		case '\'': return "&#39;";
+		case '`': return "&#96;";
+		case '=': return "&#61;";
+		default: return nullptr;
+		}
+	}
+
+	bool is_url_unreserved(unsigned char c)
+	{
+		return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~';
+	}
+}
+
+void Escaper::append(string& out, string_view value, EscapeMode mode)
+{
+	if (mode == ESC_RAW) {
+		out.append(value);
+		return;
+	}
+
+	if (mode == ESC_URL) {
+		static const char hex[] = "0123456789ABCDEF";
+		for (char ch : value) {
+			auto c = static_cast<unsigned char>(ch);
+			if (is_url_unreserved(c)) {
+				out += ch;
+			}
+			else {
+				out += '%';
+				out += hex[c >> 4];
+				out += hex[c & 0x0F];
+			}
+		}
+		return;
+	}
+
+	// Attributes additionally escape characters that can end an unquoted value
+	string_view special = (mode == ESC_ATTRIBUTE) ? string_view("&<>\"'`=") : string_view("&<>\"'");
+	size_t copied = 0;
+	size_t pos;
+	while ((pos = Scanner::find_first_of(value, special, copied)) != Scanner::npos) {
+		out.append(value, copied, pos - copied);
+		out += html_entity(value[pos]);
+		copied = pos + 1;
+	}
+	out.append(value, copied, string_view::npos);
+}
+
+string Escaper::escape(string_view value, EscapeMode mode)
+{
+	string out;
+	out.reserve(value.size());
+	append(out, value, mode);
+	return out;
+}
+
+bool Escaper::parse_mode(string_view name, EscapeMode& mode)
+{
+	if (name == "raw") mode = ESC_RAW;
+	else if (name == "html") mode = ESC_HTML;
+	else if (name == "attr" || name == "attribute") mode = ESC_ATTRIBUTE;
+	else if (name == "url") mode = ESC_URL;
+	else return false;
+	return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+enum EscapeMode
+{
+	ESC_RAW,
+	ESC_HTML,
+	ESC_ATTRIBUTE,
+	ESC_URL
+};
+
+/// <summary>
+/// Output escaping for placeholder values. Runs without special characters are
+/// found with the vectorized scanner and copied through unchanged.
+/// </summary>
+class Escaper
+{
+public:
+	static void append(std::string& out, std::string_view value, EscapeMode mode);
+	static std::string escape(std::string_view value, EscapeMode mode);
+	// Parse a mode name (raw, html, attr, url). Returns false for unknown names.
+	static bool parse_mode(std::string_view name, EscapeMode& mode);
+};
@@ -1,58 +1,415 @@
 #include "FunctionRegistry.h"
 #include "Utils.h"
+#include "Profiler.h"
+#include "TemplateProfiler.h"
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
 
 using namespace std;
 
-XtmlNamespace FunctionRegistry::RegisterNamespace(const std::string& name)
+/// <summary>
+/// Immutable set of functions published by a frozen registry. Functions are found through
+/// open addressing tables, one keyed by the namespace and function name and one by their
+/// interned ids for calls resolved at parse time, so a lookup needs neither a lock nor the
+/// symbol interner. Namespaces are shared between snapshots.
+/// </summary>
+struct FunctionSnapshot : std::enable_shared_from_this<FunctionSnapshot> {
+	struct Slot {
+		size_t hash = 0;
+		string_view namespaceName;
+		string_view functionName;
+		const XtmlFunction* function = nullptr; // Null: free slot
+	};
+
+	struct IdSlot {
+		uint64_t key = 0; // Namespace id in the high half, function id in the low half
+		const XtmlFunction* function = nullptr; // Null: free slot
+	};
+
+	unordered_map<Symbol, shared_ptr<const XtmlNamespace>> namespaces;
+	NamespaceLoader loader;
+	vector<Slot> slots;
+	vector<IdSlot> id_slots;
+	size_t mask = 0;
+
+	static uint64_t key_of(Symbol namespaceId, Symbol functionId)
+	{
+		return (static_cast<uint64_t>(namespaceId) << 32) | functionId;
+	}
+
+	static size_t hash_of(uint64_t key)
+	{
+		return static_cast<size_t>(key * 0x9E3779B97F4A7C15ull >> 16);
+	}
+
+	static size_t hash_of(string_view namespaceName, string_view functionName)
+	{
+		auto h = std::hash<string_view>{}(namespaceName);
+		return h ^ (std::hash<string_view>{}(functionName) + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+	}
+
+	// Builds the table once all namespaces are in place, the views point into them
+	void build()
+	{
+		size_t count = 0;
+		for (auto& [id, ns] : namespaces) {
+			count += ns->functions.size();
+		}
+		size_t capacity = 16;
+		while (capacity < count * 2) capacity *= 2;
+		slots.assign(capacity, Slot());
+		id_slots.assign(capacity, IdSlot());
+		mask = capacity - 1;
+
+		for (auto& [id, ns] : namespaces) {
+			for (auto& [functionId, function] : ns->functions) {
+				string_view functionName = Symbols::name(functionId);
+				auto hash = hash_of(ns->name, functionName);
+				size_t i = hash & mask;
+				while (slots[i].function) i = (i + 1) & mask;
+				slots[i] = Slot{ hash, ns->name, functionName, &function };
+
+				auto key = key_of(id, functionId);
+				i = hash_of(key) & mask;
+				while (id_slots[i].function) i = (i + 1) & mask;
+				id_slots[i] = IdSlot{ key, &function };
+			}
+		}
+	}
+
+	const XtmlFunction* find(Symbol namespaceId, Symbol functionId) const
+	{
+		auto key = key_of(namespaceId, functionId);
+		for (size_t i = hash_of(key) & mask;; i = (i + 1) & mask) {
+			auto& slot = id_slots[i];
+			if (!slot.function || slot.key == key) return slot.function;
+		}
+	}
+
+	const XtmlFunction* find(string_view namespaceName, string_view functionName) const
+	{
+		auto hash = hash_of(namespaceName, functionName);
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			auto& slot = slots[i];
+			if (!slot.function) return nullptr;
+			if (slot.hash == hash && slot.namespaceName == namespaceName && slot.functionName == functionName) return slot.function;
+		}
+	}
+
+	static shared_ptr<FunctionSnapshot> from(unordered_map<Symbol, XtmlNamespace>& registered, NamespaceLoader loader)
+	{
+		auto snapshot = make_shared<FunctionSnapshot>();
+		for (auto& [id, ns] : registered) {
+			snapshot->namespaces.emplace(id, make_shared<const XtmlNamespace>(std::move(ns)));
+		}
+		registered.clear();
+		snapshot->loader = std::move(loader);
+		snapshot->build();
+		return snapshot;
+	}
+};
+
+namespace {
+	// Epoch based reclamation of replaced snapshots. Every thread that reads snapshots owns a
+	// slot holding the epoch its outermost ReadScope started in, 0 while it reads nothing.
+	// A snapshot retired in epoch E is freed once no slot holds an epoch <= E.
+	struct ReaderSlot {
+		atomic<uint64_t> epoch{ 0 };
+		atomic<bool> in_use{ false };
+		ReaderSlot* next = nullptr;
+	};
+
+	atomic<uint64_t> g_epoch{ 1 };
+	atomic<ReaderSlot*> g_reader_slots{ nullptr }; // Never freed, reused once their thread has exited
+
+	ReaderSlot* acquire_reader_slot()
+	{
+		for (auto slot = g_reader_slots.load(memory_order_acquire); slot; slot = slot->next) {
+			bool expected = false;
+			if (!slot->in_use.load(memory_order_relaxed) && slot->in_use.compare_exchange_strong(expected, true)) {
+				return slot;
+			}
+		}
+		auto slot = new ReaderSlot();
+		slot->in_use.store(true, memory_order_relaxed);
+		slot->next = g_reader_slots.load(memory_order_relaxed);
+		while (!g_reader_slots.compare_exchange_weak(slot->next, slot, memory_order_release, memory_order_relaxed)) {}
+		return slot;
+	}
+
+	struct ThreadReaderSlot {
+		ReaderSlot* slot = acquire_reader_slot();
+		~ThreadReaderSlot()
+		{
+			slot->epoch.store(0, memory_order_release);
+			slot->in_use.store(false, memory_order_release);
+		}
+	};
+
+	ReaderSlot& reader_slot()
+	{
+		thread_local ThreadReaderSlot holder;
+		return *holder.slot;
+	}
+
+	uint64_t oldest_reader_epoch()
+	{
+		uint64_t oldest = numeric_limits<uint64_t>::max();
+		for (auto slot = g_reader_slots.load(memory_order_acquire); slot; slot = slot->next) {
+			auto epoch = slot->epoch.load(memory_order_seq_cst);
+			if (epoch != 0 && epoch < oldest) oldest = epoch;
+		}
+		return oldest;
+	}
+}
+
+FunctionRegistry::ReadScope::ReadScope()
+{
+	auto& epoch = reader_slot().epoch;
+	if (epoch.load(memory_order_relaxed) != 0) {
+		return;
+	}
+	m_epoch = &epoch;
+	epoch.store(g_epoch.load(memory_order_acquire), memory_order_relaxed);
+	// The epoch must be visible to publishers before this thread loads a snapshot
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+FunctionRegistry::ReadScope::~ReadScope()
 {
-	auto ns = XtmlNamespace{ name, {} };
-	m_namespaces[name] = ns;
+	if (m_epoch) {
+		m_epoch->store(0, memory_order_release);
+	}
+}
+
+FunctionRegistry::FunctionRegistry() = default;
+FunctionRegistry::~FunctionRegistry() = default;
+
+void FunctionRegistry::CheckNotFrozen(std::string_view what) const
+{
+	if (IsFrozen()) {
+		Utils::throw_err("Error: Function registry is frozen, cannot register " + std::string(what));
+	}
+}
+
+XtmlNamespace FunctionRegistry::RegisterNamespace(std::string_view name)
+{
+	CheckNotFrozen(name);
+	// Registering a namespace again keeps the functions it already has
+	auto& ns = m_namespaces[Symbols::intern(name)];
+	ns.name = std::string(name);
 	return ns;
 }
 
-bool FunctionRegistry::RegisterFunction(const std::string& namespaceName, const std::string& functionName, std::function<var(const std::vector<var>&)> callback, size_t minArgs, size_t maxArgs)
+bool FunctionRegistry::RegisterFunction(std::string_view namespaceName, std::string_view functionName, std::function<var(const std::vector<var>&)> callback, size_t minArgs, size_t maxArgs)
 {
-	auto it = m_namespaces.find(namespaceName);
+	CheckNotFrozen(std::string(namespaceName) + "::" + std::string(functionName));
+	auto it = m_namespaces.find(Symbols::intern(namespaceName));
 	if (it != m_namespaces.end()) {
-		it->second.functions[functionName] = XtmlFunction{ callback, minArgs, maxArgs };
+		it->second.functions[Symbols::intern(functionName)] = XtmlFunction{ callback, minArgs, maxArgs };
 		return true;
 	}
 	return false;
 }
 
-var FunctionRegistry::CallFunction(const std::string& namespaceName, const std::string& functionName, const std::vector<var>& args)
+void FunctionRegistry::Merge(FunctionRegistry& other)
 {
-	auto nsIt = m_namespaces.find(namespaceName);
-	if (nsIt != m_namespaces.end()) {
-		auto funcIt = nsIt->second.functions.find(functionName);
-		if (funcIt != nsIt->second.functions.end()) {
-			auto& func = funcIt->second;
-			if ((func.minArgs == 0 && func.maxArgs == 0) || (args.size() >= func.minArgs && (func.maxArgs == 0 || args.size() <= func.maxArgs))) {
-				return func.callback(args);
-			}
-			else {
-				Utils::printerr_ln("Error: Function " + namespaceName + "::" + functionName + " called with invalid number of arguments.");
-				return var();
-			}
+	CheckNotFrozen("merged functions");
+	for (auto& [id, ns] : other.m_namespaces) {
+		auto& target = m_namespaces[id];
+		target.name = ns.name;
+		for (auto& [functionId, function] : ns.functions) {
+			target.functions[functionId] = std::move(function);
 		}
-		else {
-			Utils::printerr_ln("Error: Function " + namespaceName + "::" + functionName + " not found.");
-			return var();
+	}
+	other.m_namespaces.clear();
+}
+
+void FunctionRegistry::SetNamespaceLoader(NamespaceLoader loader)
+{
+	CheckNotFrozen("a namespace loader");
+	m_loader = std::move(loader);
+}
+
+/// <summary>
+/// Swap in a new snapshot and free the replaced ones no reader can still see. Caller holds m_publish_mutex.
+/// </summary>
+/// <param name="snapshot"></param>
+void FunctionRegistry::Publish(shared_ptr<const FunctionSnapshot> snapshot)
+{
+	m_snapshot.store(snapshot.get(), memory_order_seq_cst);
+	if (m_current) {
+		// Readers that loaded the old pointer started in this epoch or before
+		m_retired.emplace_back(std::move(m_current), g_epoch.fetch_add(1, memory_order_seq_cst));
+	}
+	m_current = std::move(snapshot);
+	m_frozen.store(true, memory_order_release);
+
+	auto oldest = oldest_reader_epoch();
+	m_retired.erase(remove_if(m_retired.begin(), m_retired.end(), [oldest](const auto& retired) { return retired.second < oldest; }), m_retired.end());
+}
+
+void FunctionRegistry::Freeze()
+{
+	if (IsFrozen()) return;
+	lock_guard<mutex> lock(m_publish_mutex);
+	if (IsFrozen()) return;
+	Publish(FunctionSnapshot::from(m_namespaces, std::move(m_loader)));
+}
+
+void FunctionRegistry::Reload(FunctionRegistry& staged)
+{
+	staged.CheckNotFrozen("a reload from a frozen registry");
+	auto snapshot = FunctionSnapshot::from(staged.m_namespaces, std::move(staged.m_loader));
+
+	lock_guard<mutex> lock(m_publish_mutex);
+	m_namespaces.clear();
+	m_requested_namespaces.clear();
+	Publish(std::move(snapshot));
+}
+
+const XtmlFunction* FunctionRegistry::LoadNamespace(std::string_view namespaceName, std::string_view functionName)
+{
+	lock_guard<mutex> lock(m_publish_mutex);
+	auto current = m_current.get();
+	// Each name is passed to the loader once; misses are remembered here instead of in the snapshot
+	if (m_requested_namespaces.emplace(namespaceName).second) {
+		FunctionRegistry loaded;
+		if (current->loader(namespaceName, loaded) && !loaded.m_namespaces.empty()) {
+			auto snapshot = make_shared<FunctionSnapshot>();
+			snapshot->namespaces = current->namespaces;
+			snapshot->loader = current->loader;
+			for (auto& [id, ns] : loaded.m_namespaces) {
+				auto& target = snapshot->namespaces[id];
+				if (!target) {
+					target = make_shared<const XtmlNamespace>(std::move(ns));
+					continue;
+				}
+				// A module extending a namespace (e.g. std) adds functions, registered ones stay
+				auto merged = make_shared<XtmlNamespace>(*target);
+				for (auto& [functionId, function] : ns.functions) {
+					merged->functions.emplace(functionId, std::move(function));
+				}
+				target = std::move(merged);
+			}
+			snapshot->build();
+			current = snapshot.get();
+			Publish(std::move(snapshot));
 		}
 	}
+	return current->find(namespaceName, functionName);
+}
+
+var FunctionRegistry::CallFunction(std::string_view namespaceName, std::string_view functionName, const std::vector<var>& args)
+{
+	ReadScope read;
+	if (auto func = FindFunction(namespaceName, functionName)) {
+		return Invoke(*func, namespaceName, functionName, args);
+	}
+	Utils::printerr_ln("Error: Function " + std::string(namespaceName) + "::" + std::string(functionName) + " not found.");
 	return var();
 }
 
-bool FunctionRegistry::Exists(const std::string& namespaceName, const std::string& functionName)
+bool FunctionRegistry::Exists(std::string_view namespaceName, std::string_view functionName)
 {
-	auto nsIt = m_namespaces.find(namespaceName);
+	ReadScope read;
+	return FindFunction(namespaceName, functionName) != nullptr;
+}
+
+const XtmlFunction* FunctionRegistry::FindFunction(Symbol namespaceId, Symbol functionId) const
+{
+	if (namespaceId == Symbols::none || functionId == Symbols::none) {
+		return nullptr;
+	}
+	if (IsFrozen()) {
+		auto snapshot = m_snapshot.load(memory_order_acquire);
+		if (auto function = snapshot->find(namespaceId, functionId)) {
+			return function;
+		}
+		// The loader may provide the namespace, or more functions for a registered one
+		auto& namespaceName = Symbols::name(namespaceId);
+		auto& functionName = Symbols::name(functionId);
+		if (snapshot->loader && !namespaceName.empty() && !functionName.empty()) {
+			return const_cast<FunctionRegistry*>(this)->LoadNamespace(namespaceName, functionName);
+		}
+		return nullptr;
+	}
+	auto nsIt = m_namespaces.find(namespaceId);
 	if (nsIt != m_namespaces.end()) {
-		auto funcIt = nsIt->second.functions.find(functionName);
+		auto funcIt = nsIt->second.functions.find(functionId);
 		if (funcIt != nsIt->second.functions.end()) {
-			return true;
+			return &funcIt->second;
 		}
 	}
-	return false;
+	return nullptr;
+}
+
+const XtmlFunction* FunctionRegistry::FindFunction(std::string_view namespaceName, std::string_view functionName) const
+{
+	if (!IsFrozen()) {
+		// Registration phase: only the registering thread looks up
+		return FindFunction(Symbols::find(namespaceName), Symbols::find(functionName));
+	}
+	auto snapshot = m_snapshot.load(memory_order_acquire);
+	if (auto function = snapshot->find(namespaceName, functionName)) {
+		return function;
+	}
+	// The loader may provide the namespace, or more functions for a registered one
+	if (snapshot->loader && !namespaceName.empty() && !functionName.empty()) {
+		return const_cast<FunctionRegistry*>(this)->LoadNamespace(namespaceName, functionName);
+	}
+	return nullptr;
+}
+
+FunctionRef FunctionRegistry::FindFunctionRef(std::string_view namespaceName, std::string_view functionName) const
+{
+	ReadScope read;
+	if (!IsFrozen()) {
+		// Registration phase: the registry owns the function
+		return FunctionRef(FunctionRef(), FindFunction(namespaceName, functionName));
+	}
+	// A namespace loaded on first use is in the snapshot published by FindFunction
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		auto snapshot = m_snapshot.load(memory_order_acquire);
+		if (auto function = snapshot->find(namespaceName, functionName)) {
+			return FunctionRef(snapshot->shared_from_this(), function);
+		}
+		if (attempt == 0 && !FindFunction(namespaceName, functionName)) {
+			break;
+		}
+	}
+	return nullptr;
+}
+
+std::vector<std::string> FunctionRegistry::NamespaceNames() const
+{
+	std::vector<std::string> names;
+	if (IsFrozen()) {
+		ReadScope read;
+		for (auto& [id, ns] : m_snapshot.load(memory_order_acquire)->namespaces) {
+			names.push_back(ns->name);
+		}
+	}
+	else {
+		for (auto& [id, ns] : m_namespaces) {
+			names.push_back(ns.name);
+		}
+	}
+	return names;
+}
+
+var FunctionRegistry::Invoke(const XtmlFunction& func, std::string_view namespaceName, std::string_view functionName, const std::vector<var>& args)
+{
+	ProfileScope profile(PS_FUNCTION_CALL);
+	// Labelled with the position of the calling statement, so calls from different lines get their own frames
+	TemplateFrame profile_frame(TemplateProfiler::enabled() ? TemplateProfiler::frame_label(std::string(namespaceName) + "::" + std::string(functionName) + "()") : std::string());
+	if ((func.minArgs == 0 && func.maxArgs == 0) || (args.size() >= func.minArgs && (func.maxArgs == 0 || args.size() <= func.maxArgs))) {
+		return func.callback(args);
+	}
+	Utils::printerr_ln("Error: Function " + std::string(namespaceName) + "::" + std::string(functionName) + " called with invalid number of arguments.");
+	return var();
 }
 
 tuple<std::string, std::string, vector<string>> FunctionRegistry::ParseFunctionCall(const std::string& expr)
@@ -63,10 +420,11 @@ tuple<std::string, std::string, vector<string>> FunctionRegistry::ParseFunctionC
 	if (nsFuncSplit == std::string::npos) {
 		Utils::throw_err("Error: Invalid function call expression: " + expr);
 	}
-	auto namespaceName = Utils::trim(expr.substr(0, nsFuncSplit));
-	auto rest = Utils::trim(expr.substr(nsFuncSplit + 2));
+	std::string_view view = expr;
+	auto namespaceName = Utils::trim(view.substr(0, nsFuncSplit));
+	auto rest = Utils::trim_view(view.substr(nsFuncSplit + 2));
 	auto parenPos = rest.find('(');
-	if (parenPos == std::string::npos || rest.back() != ')') {
+	if (parenPos == std::string_view::npos || rest.back() != ')') {
 		Utils::throw_err("Error: Invalid function call expression: " + expr);
 	}
 	auto functionName = Utils::trim(rest.substr(0, parenPos));
@@ -3,8 +3,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <string_view>
 #include <tuple>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <cstdint>
 #include "Vars.h"
+#include "Symbols.h"
 
 struct XtmlFunction {
 	std::function<var(const std::vector<var>&)> callback;
@@ -14,19 +22,102 @@ struct XtmlFunction {
 
 struct XtmlNamespace {
 	std::string name;
-	std::map<std::string, XtmlFunction> functions;
+	std::unordered_map<Symbol, XtmlFunction> functions;
 };
 
+/// <summary>
+/// A function call of an expression, parsed and resolved to interned ids when its AST node is built
+/// </summary>
+struct FunctionCall {
+	std::string namespaceName;
+	std::string functionName;
+	Symbol namespaceId = Symbols::none;
+	Symbol functionId = Symbols::none;
+	std::vector<CompiledExpr> args;
+};
+
+class FunctionRegistry;
+struct FunctionSnapshot;
+
+// Keeps the snapshot the function was found in alive, also across reloads
+typedef std::shared_ptr<const XtmlFunction> FunctionRef;
+
+// Registers the functions of a namespace that is not loaded yet into registry, false if the namespace is unknown
+typedef std::function<bool(std::string_view namespaceName, FunctionRegistry& registry)> NamespaceLoader;
+
+/// <summary>
+/// Functions callable from templates. Functions are registered first, from one thread;
+/// Freeze then publishes them as an immutable snapshot (a flat hash table keyed by
+/// namespace and function name) behind a plain atomic pointer, which any number of render
+/// threads read without locks or reference counts. Reload and namespaces loaded on first
+/// use publish a new snapshot; the replaced one is retired and freed at a later publish
+/// once no ReadScope that could still see it is open (epoch based reclamation).
+/// FindFunction results are valid inside a ReadScope; FindFunctionRef keeps a function
+/// alive across reloads.
+/// </summary>
 class FunctionRegistry
 {
 private:
-	std::map<std::string, XtmlNamespace> m_namespaces;
+	// Registration phase
+	std::unordered_map<Symbol, XtmlNamespace> m_namespaces;
+	NamespaceLoader m_loader;
+
+	// Frozen phase
+	std::atomic<const FunctionSnapshot*> m_snapshot{ nullptr };
+	std::atomic<bool> m_frozen{ false };
+	std::mutex m_publish_mutex; // Serializes snapshot changes, lookups of registered functions never take it
+	// Guarded by m_publish_mutex
+	std::shared_ptr<const FunctionSnapshot> m_current; // Owns m_snapshot
+	std::vector<std::pair<std::shared_ptr<const FunctionSnapshot>, uint64_t>> m_retired; // Replaced snapshots and the epoch they were retired in
+	std::unordered_set<std::string> m_requested_namespaces; // Names already passed to the loader
+
+	void Publish(std::shared_ptr<const FunctionSnapshot> snapshot);
+	const XtmlFunction* LoadNamespace(std::string_view namespaceName, std::string_view functionName);
+	void CheckNotFrozen(std::string_view what) const;
 public:
-	XtmlNamespace RegisterNamespace(const std::string& name);
-	bool RegisterFunction(const std::string& namespaceName, const std::string& functionName, std::function<var(const std::vector<var>&)> callback, size_t minArgs = 0, size_t maxArgs = 0);
-	var CallFunction(const std::string& namespaceName, const std::string& functionName, const std::vector<var>& args);
-	bool Exists(const std::string& namespaceName, const std::string& functionName);
+	/// <summary>
+	/// Marks the calling thread as reading snapshots: functions found while the outermost
+	/// scope is open stay valid until it closes, even if a reload replaces them. Renders hold
+	/// one for their whole duration, so the scopes opened around each call are nested and cost
+	/// a thread local check.
+	/// </summary>
+	class ReadScope
+	{
+	private:
+		std::atomic<uint64_t>* m_epoch = nullptr; // Slot of this thread, null when nested
+	public:
+		ReadScope();
+		~ReadScope();
+		ReadScope(const ReadScope&) = delete;
+		ReadScope& operator=(const ReadScope&) = delete;
+	};
+
+	FunctionRegistry();
+	~FunctionRegistry();
+	FunctionRegistry(const FunctionRegistry&) = delete;
+	FunctionRegistry& operator=(const FunctionRegistry&) = delete;
+
+	XtmlNamespace RegisterNamespace(std::string_view name);
+	bool RegisterFunction(std::string_view namespaceName, std::string_view functionName, std::function<var(const std::vector<var>&)> callback, size_t minArgs = 0, size_t maxArgs = 0);
+	void Merge(FunctionRegistry& other); // Adds the namespaces and functions of other, which is left empty
+	void SetNamespaceLoader(NamespaceLoader loader); // Namespaces are loaded on first use once frozen
+
+	// Ends registration, safe to call more than once and from several threads
+	void Freeze();
+	bool IsFrozen() const { return m_frozen.load(std::memory_order_acquire); }
+	// Hot reload: publish the functions and loader of staged, a registry still in its registration phase
+	void Reload(FunctionRegistry& staged);
+
+	var CallFunction(std::string_view namespaceName, std::string_view functionName, const std::vector<var>& args);
+	bool Exists(std::string_view namespaceName, std::string_view functionName);
+	// Valid until the snapshot is replaced and the ReadScopes open at that time have closed
+	const XtmlFunction* FindFunction(Symbol namespaceId, Symbol functionId) const;
+	const XtmlFunction* FindFunction(std::string_view namespaceName, std::string_view functionName) const;
+	// For callers that keep a function beyond their ReadScope, e.g. across a reload
+	FunctionRef FindFunctionRef(std::string_view namespaceName, std::string_view functionName) const;
+	std::vector<std::string> NamespaceNames() const;
 
+	static var Invoke(const XtmlFunction& func, std::string_view namespaceName, std::string_view functionName, const std::vector<var>& args);
 	static std::tuple<std::string, std::string, std::vector<std::string>> ParseFunctionCall(const std::string& expr);
 	static std::vector<std::string> parse_function_args(const std::string& argsStr);
 
@@ -0,0 +1,91 @@
+#include "Iterable.h"
+#include "Utils.h"
+#include <string>
+
+using namespace std;
+
+namespace {
+	class RangeIterator : public VarIterator
+	{
+	private:
+		int64_t m_current;
+		int64_t m_end;
+		int64_t m_step;
+	public:
+		RangeIterator(int64_t start, int64_t end, int64_t step) : m_current(start), m_end(end), m_step(step) {}
+
+		bool next(var& out) override {
+			if ((m_step > 0 && m_current >= m_end) || (m_step < 0 && m_current <= m_end)) {
+				return false;
+			}
+			out.value = to_string(m_current);
+			out.type = DT_NUMBER;
+			m_current += m_step;
+			return true;
+		}
+	};
+
+	class GeneratorIterator : public VarIterator
+	{
+	private:
+		GeneratorIterable::Generator m_generator;
+	public:
+		GeneratorIterator(GeneratorIterable::Generator generator) : m_generator(move(generator)) {}
+
+		bool next(var& out) override {
+			return m_generator && m_generator(out);
+		}
+	};
+}
+
+ArrayIterator::ArrayIterator(const VarArray& items, size_t start, size_t end) : m_items(items)
+{
+	m_end = min(end, m_items.size());
+	m_index = min(start, m_end);
+}
+
+bool ArrayIterator::next(var& out)
+{
+	if (m_index >= m_end) return false;
+	m_items.load(m_index++, out);
+	return true;
+}
+
+RangeIterable::RangeIterable(int64_t start, int64_t end, int64_t step) : m_start(start), m_end(end), m_step(step)
+{
+	if (step == 0) {
+		Utils::throw_err("Error: Range step must not be zero.");
+	}
+}
+
+unique_ptr<VarIterator> RangeIterable::iterate() const
+{
+	return make_unique<RangeIterator>(m_start, m_end, m_step);
+}
+
+size_t RangeIterable::size() const
+{
+	if (m_step > 0 && m_end > m_start) {
+		return static_cast<size_t>((m_end - m_start + m_step - 1) / m_step);
+	}
+	if (m_step < 0 && m_end < m_start) {
+		return static_cast<size_t>((m_start - m_end - m_step - 1) / -m_step);
+	}
+	return 0;
+}
+
+SliceIterable::SliceIterable(const VarArray& source, size_t start, size_t end) : m_source(source)
+{
+	m_end = min(end, m_source.size());
+	m_start = min(start, m_end);
+}
+
+unique_ptr<VarIterator> SliceIterable::iterate() const
+{
+	return make_unique<ArrayIterator>(m_source, m_start, m_end);
+}
+
+unique_ptr<VarIterator> GeneratorIterable::iterate() const
+{
+	return make_unique<GeneratorIterator>(m_factory ? m_factory() : Generator());
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "Vars.h"
+
+/// <summary>
+/// Cursor over a collection. Writes one element per call into the given var
+/// and returns false once the collection is exhausted.
+/// </summary>
+class VarIterator
+{
+public:
+	virtual ~VarIterator() = default;
+	virtual bool next(var& out) = 0;
+};
+
+/// <summary>
+/// Lazy collection (DT_ITERABLE). Elements are produced on demand by @foreach
+/// instead of being materialised into an array.
+/// </summary>
+class VarIterable
+{
+public:
+	static constexpr size_t unknown_size = SIZE_MAX;
+
+	virtual ~VarIterable() = default;
+	virtual std::unique_ptr<VarIterator> iterate() const = 0;
+	virtual size_t size() const { return unknown_size; }
+};
+
+/// <summary>
+/// Iterator over the elements of a DT_ARRAY value. Holds its own reference to
+/// the shared buffer, so reassigning the collection inside the loop is safe.
+/// </summary>
+class ArrayIterator : public VarIterator
+{
+private:
+	VarArray m_items;
+	size_t m_index;
+	size_t m_end;
+public:
+	ArrayIterator(const VarArray& items, size_t start = 0, size_t end = SIZE_MAX);
+	bool next(var& out) override;
+};
+
+/// <summary>
+/// Numeric range [start, end) with a step, e.g. std::range(0, 10, 2)
+/// </summary>
+class RangeIterable : public VarIterable
+{
+private:
+	int64_t m_start;
+	int64_t m_end;
+	int64_t m_step;
+public:
+	RangeIterable(int64_t start, int64_t end, int64_t step);
+	std::unique_ptr<VarIterator> iterate() const override;
+	size_t size() const override;
+};
+
+/// <summary>
+/// View over a part [start, end) of an array, e.g. std::slice(items, 10, 20)
+/// </summary>
+class SliceIterable : public VarIterable
+{
+private:
+	VarArray m_source;
+	size_t m_start;
+	size_t m_end;
+public:
+	SliceIterable(const VarArray& source, size_t start, size_t end);
+	std::unique_ptr<VarIterator> iterate() const override;
+	size_t size() const override { return m_end - m_start; }
+};
+
+/// <summary>
+/// Module provided generator. The factory is called once per iteration and
+/// returns a function that yields the next element until it returns false.
+/// </summary>
+class GeneratorIterable : public VarIterable
+{
+public:
+	using Generator = std::function<bool(var&)>;
+	using Factory = std::function<Generator()>;
+private:
+	Factory m_factory;
+	size_t m_size;
+public:
+	GeneratorIterable(Factory factory, size_t size = unknown_size) : m_factory(std::move(factory)), m_size(size) {}
+	std::unique_ptr<VarIterator> iterate() const override;
+	size_t size() const override { return m_size; }
+};
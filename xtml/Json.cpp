@@ -0,0 +1,370 @@
+#include "Json.h"
+#include "Iterable.h"
+#include "MappedFile.h"
+#include "Scanner.h"
+#include "Utils.h"
+#include <fstream>
+#include <memory>
+
+using namespace std;
+
+namespace {
+	class JsonReader
+	{
+	private:
+		// Deeper documents are rejected instead of exhausting the stack
+		static constexpr int max_depth = 512;
+
+		string_view m_text;
+		size_t m_pos = 0;
+		int m_depth = 0;
+
+		void enter()
+		{
+			if (++m_depth > max_depth) {
+				fail("nesting deeper than " + to_string(max_depth) + " levels");
+			}
+		}
+
+		[[noreturn]] void fail(const string& message) const
+		{
+			Utils::throw_err("Error: Invalid JSON at offset " + to_string(m_pos) + ": " + message);
+			throw runtime_error(message); // Not reached, throw_err always throws
+		}
+
+		void skip_whitespace()
+		{
+			while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r')) {
+				m_pos++;
+			}
+		}
+
+		void expect(char c)
+		{
+			skip_whitespace();
+			if (m_pos >= m_text.size() || m_text[m_pos] != c) {
+				fail(string("expected '") + c + "'");
+			}
+			m_pos++;
+		}
+
+		bool consume(string_view word)
+		{
+			if (m_text.compare(m_pos, word.size(), word) == 0) {
+				m_pos += word.size();
+				return true;
+			}
+			return false;
+		}
+
+		unsigned read_hex4()
+		{
+			if (m_pos + 4 > m_text.size()) fail("truncated \\u escape");
+			unsigned code = 0;
+			for (int i = 0; i < 4; ++i) {
+				char c = m_text[m_pos++];
+				code <<= 4;
+				if (c >= '0' && c <= '9') code |= c - '0';
+				else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+				else fail("invalid \\u escape");
+			}
+			return code;
+		}
+
+		static void append_utf8(string& out, unsigned code)
+		{
+			if (code < 0x80) {
+				out += static_cast<char>(code);
+			}
+			else if (code < 0x800) {
+				out += static_cast<char>(0xC0 | (code >> 6));
+				out += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else if (code < 0x10000) {
+				out += static_cast<char>(0xE0 | (code >> 12));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else {
+				out += static_cast<char>(0xF0 | (code >> 18));
+				out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (code & 0x3F));
+			}
+		}
+
+		string read_string()
+		{
+			expect('"');
+			string result;
+			while (true) {
+				// Copy the run up to the next quote or escape in one go
+				size_t end = m_text.find_first_of("\"\\", m_pos);
+				if (end == string_view::npos) fail("unterminated string");
+				result.append(m_text, m_pos, end - m_pos);
+				m_pos = end + 1;
+				if (m_text[end] == '"') {
+					return result;
+				}
+				if (m_pos >= m_text.size()) fail("unterminated string");
+				char c = m_text[m_pos++];
+				switch (c) {
+				case '"': result += '"'; break;
+				case '\\': result += '\\'; break;
+				case '/': result += '/'; break;
+				case 'b': result += '\b'; break;
+				case 'f': result += '\f'; break;
+				case 'n': result += '\n'; break;
+				case 'r': result += '\r'; break;
+				case 't': result += '\t'; break;
+				case 'u': {
+					unsigned code = read_hex4();
+					if (code >= 0xD800 && code <= 0xDBFF && consume("\\u")) {
+						unsigned low = read_hex4();
+						if (low >= 0xDC00 && low <= 0xDFFF) {
+							code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						}
+						else {
+							append_utf8(result, code);
+							code = low;
+						}
+					}
+					append_utf8(result, code);
+					break;
+				}
+				default:
+					fail(string("invalid escape '\\") + c + "'");
+				}
+			}
+		}
+
+		var read_number()
+		{
+			size_t start = m_pos;
+			bool integer = true;
+			if (m_text[m_pos] == '-') m_pos++;
+			while (m_pos < m_text.size()) {
+				char c = m_text[m_pos];
+				if (c >= '0' && c <= '9') {
+					m_pos++;
+				}
+				else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+					integer = false;
+					m_pos++;
+				}
+				else {
+					break;
+				}
+			}
+			string number(m_text.substr(start, m_pos - start));
+			if (number.empty() || number == "-") fail("invalid number");
+			// Expressions only do integer arithmetic, other numbers are kept as text
+			bool fits = number.size() - (number[0] == '-') <= 18;
+			return var{ number, integer && fits ? DT_NUMBER : DT_STRING };
+		}
+
+	public:
+		explicit JsonReader(string_view text) : m_text(text) {}
+
+		var read_value()
+		{
+			skip_whitespace();
+			if (m_pos >= m_text.size()) fail("unexpected end of input");
+
+			char c = m_text[m_pos];
+			if (c == '{') {
+				m_pos++;
+				enter();
+				auto object = make_shared<VarObject>();
+				skip_whitespace();
+				if (m_pos < m_text.size() && m_text[m_pos] == '}') {
+					m_pos++;
+				}
+				else {
+					while (true) {
+						skip_whitespace();
+						auto key = read_string();
+						expect(':');
+						object->fields[move(key)] = read_value();
+						skip_whitespace();
+						if (consume(",")) continue;
+						expect('}');
+						break;
+					}
+				}
+				var result{ "", DT_OBJECT };
+				result.object = move(object);
+				m_depth--;
+				return result;
+			}
+			if (c == '[') {
+				m_pos++;
+				enter();
+				var result{ "", DT_ARRAY };
+				skip_whitespace();
+				if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+					m_pos++;
+					m_depth--;
+					return result;
+				}
+				while (true) {
+					result.array.push_back(read_value());
+					skip_whitespace();
+					if (consume(",")) continue;
+					expect(']');
+					m_depth--;
+					return result;
+				}
+			}
+			if (c == '"') return var{ read_string(), DT_STRING };
+			if (consume("true")) return var{ "1", DT_BOOL };
+			if (consume("false")) return var{ "0", DT_BOOL };
+			if (consume("null")) return var{ "", DT_STRING };
+			if (c == '-' || (c >= '0' && c <= '9')) return read_number();
+			fail(string("unexpected character '") + c + "'");
+		}
+
+		void finish()
+		{
+			skip_whitespace();
+			if (m_pos != m_text.size()) fail("unexpected data after value");
+		}
+	};
+
+	/// <summary>
+	/// Reads the elements of a top level JSON array one at a time from a mapping of
+	/// the file. Elements are parsed in place, nothing but the current value is kept.
+	/// </summary>
+	class ArrayElementReader
+	{
+	private:
+		MappedFile m_file;
+		string_view m_text;
+		size_t m_pos = 0;
+		string m_path;
+		bool m_done = false;
+
+		void skip_whitespace()
+		{
+			while (m_pos < m_text.size() && isspace(static_cast<unsigned char>(m_text[m_pos]))) m_pos++;
+		}
+
+	public:
+		ArrayElementReader(const string& path) : m_file(path), m_text(m_file.view()), m_path(path)
+		{
+			skip_whitespace();
+			if (m_pos >= m_text.size() || m_text[m_pos] != '[') {
+				Utils::throw_err("Error: Expected a JSON array in " + path);
+			}
+			m_pos++;
+			skip_whitespace();
+			if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+				m_done = true;
+			}
+		}
+
+		bool next(var& out)
+		{
+			if (m_done) return false;
+
+			// Find the ',' or ']' that ends the element at depth 0, jumping between
+			// structural bytes and skipping over strings
+			size_t start = m_pos;
+			int depth = 0;
+			while (true) {
+				size_t pos = Scanner::find_first_of(m_text, "\"{}[],", m_pos);
+				if (pos == Scanner::npos) {
+					Utils::throw_err("Error: Unterminated JSON array in " + m_path);
+				}
+				char c = m_text[pos];
+				m_pos = pos + 1;
+				if (c == '"') {
+					while (true) {
+						size_t quote = Scanner::find_either(m_text, '"', '\\', m_pos);
+						if (quote == Scanner::npos) {
+							Utils::throw_err("Error: Unterminated JSON array in " + m_path);
+						}
+						m_pos = quote + (m_text[quote] == '\\' ? 2 : 1);
+						if (m_text[quote] == '"') break;
+					}
+				}
+				else if (c == '{' || c == '[') depth++;
+				else if (c == '}' || c == ']') {
+					if (depth == 0) {
+						m_done = true;
+						break;
+					}
+					depth--;
+				}
+				else if (c == ',' && depth == 0) {
+					break;
+				}
+			}
+			out = Json::parse(m_text.substr(start, m_pos - 1 - start));
+			return true;
+		}
+	};
+
+	bool is_json_lines(const string& path)
+	{
+		return Utils::ends_with(path, ".jsonl") || Utils::ends_with(path, ".ndjson");
+	}
+
+	char first_significant_char(const string& path)
+	{
+		ifstream file(path, ios::binary);
+		if (!file.is_open()) {
+			Utils::throw_err("Error: Could not open data file: " + path);
+		}
+		char c;
+		while (file.get(c)) {
+			if (!isspace(static_cast<unsigned char>(c))) return c;
+		}
+		return '\0';
+	}
+}
+
+var Json::parse(string_view text)
+{
+	JsonReader reader(text);
+	auto result = reader.read_value();
+	reader.finish();
+	return result;
+}
+
+var Json::load_file(const string& path)
+{
+	if (is_json_lines(path)) {
+		// One document per line, blank lines are skipped
+		auto factory = [path]() -> GeneratorIterable::Generator {
+			auto file = make_shared<ifstream>(path, ios::binary);
+			if (!file->is_open()) {
+				Utils::throw_err("Error: Could not open data file: " + path);
+			}
+			return [file](var& out) {
+				string line;
+				while (getline(*file, line)) {
+					if (!Utils::trim_view(line).empty()) {
+						out = Json::parse(line);
+						return true;
+					}
+				}
+				return false;
+			};
+		};
+		return var{ "", DT_ITERABLE, {}, make_shared<GeneratorIterable>(factory) };
+	}
+
+	if (first_significant_char(path) == '[') {
+		auto factory = [path]() -> GeneratorIterable::Generator {
+			auto reader = make_shared<ArrayElementReader>(path);
+			return [reader](var& out) { return reader->next(out); };
+		};
+		return var{ "", DT_ITERABLE, {}, make_shared<GeneratorIterable>(factory) };
+	}
+
+	// The reader copies values out of the text, so it can scan the mapping directly
+	MappedFile file(path);
+	return parse(file.view());
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "Vars.h"
+
+/// <summary>
+/// JSON and JSON Lines reader for template data. Objects become DT_OBJECT, arrays
+/// DT_ARRAY, integers DT_NUMBER, true/false DT_BOOL; other numbers, strings and
+/// null become DT_STRING (null as an empty string).
+/// </summary>
+class Json
+{
+public:
+	// Parse a complete JSON document
+	static var parse(std::string_view text);
+	// Load a .json or .jsonl/.ndjson file. JSON Lines files and top level arrays are
+	// returned as a DT_ITERABLE that reads one element at a time from disk.
+	static var load_file(const std::string& path);
+};
@@ -0,0 +1,113 @@
+#include "Logger.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+std::atomic<int> Logger::s_level(LL_INFO);
+std::atomic<bool> Logger::s_json(false);
+
+namespace {
+	constexpr size_t flush_threshold = 64 * 1024;
+
+	mutex sink_mutex;
+	string out_buffer;
+	string err_buffer;
+
+	void flush_locked()
+	{
+		if (!out_buffer.empty()) {
+			fwrite(out_buffer.data(), 1, out_buffer.size(), stdout);
+			fflush(stdout);
+			out_buffer.clear();
+		}
+		if (!err_buffer.empty()) {
+			fwrite(err_buffer.data(), 1, err_buffer.size(), stderr);
+			fflush(stderr);
+			err_buffer.clear();
+		}
+	}
+
+	void append_json_string(string& out, string_view value)
+	{
+		out += '"';
+		for (char c : value) {
+			switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out += escaped;
+				}
+				else {
+					out += c;
+				}
+			}
+		}
+		out += '"';
+	}
+
+	// Writes what is left when the process exits normally
+	struct FlushAtExit {
+		~FlushAtExit() { Logger::flush(); }
+	} flush_at_exit;
+}
+
+bool Logger::parse_level(string_view name, LogLevel& level)
+{
+	if (name == "quiet") level = LL_ERROR;
+	else if (name == "info") level = LL_INFO;
+	else if (name == "debug") level = LL_DEBUG;
+	else if (name == "trace") level = LL_TRACE;
+	else return false;
+	return true;
+}
+
+const char* Logger::level_name(LogLevel level)
+{
+	switch (level) {
+	case LL_ERROR: return "error";
+	case LL_INFO: return "info";
+	case LL_DEBUG: return "debug";
+	default: return "trace";
+	}
+}
+
+void Logger::write(LogLevel level, string_view message)
+{
+	if (!enabled(level)) return;
+
+	lock_guard<mutex> lock(sink_mutex);
+	string& buffer = level == LL_ERROR ? err_buffer : out_buffer;
+	if (json()) {
+		auto now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		buffer += "{\"ts\":" + to_string(now) + ",\"level\":\"" + level_name(level) + "\",\"message\":";
+		append_json_string(buffer, message);
+		buffer += "}\n";
+	}
+	else {
+		buffer.append(message);
+		buffer += '\n';
+	}
+
+	if (level == LL_ERROR) {
+		// Keep errors in order with the output before them and visible even if the process aborts
+		flush_locked();
+	}
+	else if (out_buffer.size() >= flush_threshold) {
+		flush_locked();
+	}
+}
+
+void Logger::flush()
+{
+	lock_guard<mutex> lock(sink_mutex);
+	flush_locked();
+}
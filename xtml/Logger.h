@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <string_view>
+
+enum LogLevel
+{
+	LL_ERROR, // Always written, the only level left in quiet mode
+	LL_INFO,
+	LL_DEBUG,
+	LL_TRACE
+};
+
+/// <summary>
+/// Leveled console logger. Lines are buffered and written in blocks; errors
+/// flush everything written before them so the order on the console is kept.
+/// Thread-safe. Guard messages that are expensive to build with enabled().
+/// </summary>
+class Logger
+{
+private:
+	static std::atomic<int> s_level;
+	static std::atomic<bool> s_json;
+public:
+	static bool enabled(LogLevel level) { return level <= s_level.load(std::memory_order_relaxed); }
+	static void set_level(LogLevel level) { s_level.store(level, std::memory_order_relaxed); }
+	static LogLevel level() { return LogLevel(s_level.load(std::memory_order_relaxed)); }
+	// quiet, info, debug or trace. Returns false for unknown names.
+	static bool parse_level(std::string_view name, LogLevel& level);
+	static const char* level_name(LogLevel level);
+
+	// One JSON object per line instead of plain text
+	static void set_json(bool json) { s_json.store(json, std::memory_order_relaxed); }
+	static bool json() { return s_json.load(std::memory_order_relaxed); }
+
+	static void write(LogLevel level, std::string_view message);
+	static void flush();
+};
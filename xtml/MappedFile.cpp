@@ -0,0 +1,60 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile(const string& path)
+{
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw runtime_error("Could not open file: " + path);
+	}
+
+	struct stat info {};
+	bool is_empty = false;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+			m_data = static_cast<const char*>(data);
+			m_size = static_cast<size_t>(info.st_size);
+			m_mapped = true;
+		}
+	}
+	else if (S_ISREG(info.st_mode) && info.st_size == 0) {
+		is_empty = true;
+	}
+	close(fd);
+	if (m_mapped || is_empty) {
+		return;
+	}
+#endif
+
+	// Fallback: read the whole file into the owned buffer (text mode, as before)
+	ifstream file(path);
+	if (!file.is_open()) {
+		throw runtime_error("Could not open file: " + path);
+	}
+	m_buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	if (m_mapped) {
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+#endif
+}
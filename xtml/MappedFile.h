@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+/// <summary>
+/// Read-only view of a whole file. On POSIX systems the file is mapped with mmap
+/// and read sequentially, elsewhere it is read into an owned buffer.
+/// </summary>
+class MappedFile
+{
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_mapped = false;
+	std::string m_buffer; // Used when the file could not be mapped
+
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	std::string_view view() const { return std::string_view(m_data, m_size); }
+	size_t size() const { return m_size; }
+};
@@ -0,0 +1,149 @@
+#include "Minifier.h"
+#include "Utils.h"
+#include <cctype>
+
+using namespace std;
+
+void Minifier::write(string_view chunk)
+{
+	size_t start = 0;
+	size_t newline;
+	while ((newline = chunk.find('\n', start)) != string_view::npos) {
+		if (m_line.empty()) {
+			process_line(chunk.substr(start, newline - start));
+		}
+		else {
+			m_line.append(chunk, start, newline - start);
+			process_line(m_line);
+			m_line.clear();
+		}
+		start = newline + 1;
+	}
+	m_line.append(chunk, start, string_view::npos);
+}
+
+string Minifier::finish()
+{
+	if (!m_line.empty()) {
+		process_line(m_line);
+		m_line.clear();
+	}
+	m_pending_space = '\0';
+	return move(m_output);
+}
+
+string Minifier::minify(string_view content, const MinifyOptions& options)
+{
+	Minifier minifier(options);
+	minifier.write(content);
+	return minifier.finish();
+}
+
+void Minifier::process_line(string_view line)
+{
+	if (m_raw_element.empty() && !m_in_comment) {
+		auto trimmed = Utils::trim_view(line);
+		if (m_options.strip_var_lines && trimmed.starts_with("@var")) {
+			return;
+		}
+		if (m_options.trim_lines) {
+			line = trimmed;
+		}
+	}
+
+	emit_text(line);
+
+	// Every line ends with a newline, like getline based cleanup did
+	if (!m_raw_element.empty() || !m_options.collapse_whitespace) {
+		m_pending_space = '\0';
+		m_output += '\n';
+	}
+	else {
+		m_pending_space = '\n';
+	}
+}
+
+void Minifier::emit_text(string_view text)
+{
+	for (size_t i = 0; i < text.size(); ++i) {
+		char c = text[i];
+
+		if (m_in_comment) {
+			if (c == '>' && m_comment_dashes >= 2) {
+				m_in_comment = false;
+			}
+			m_comment_dashes = (c == '-') ? m_comment_dashes + 1 : 0;
+			continue;
+		}
+
+		if (!m_raw_element.empty()) {
+			if (c != '<' || match_raw_element(text, i, true) != m_raw_element) {
+				m_output += c;
+				continue;
+			}
+			m_raw_element.clear();
+		}
+
+		if (c == '<') {
+			if (m_options.strip_comments && text.compare(i, 4, "<!--") == 0 && text.compare(i, 5, "<!--[") != 0) {
+				m_in_comment = true;
+				m_comment_dashes = 0;
+				i += 3;
+				continue;
+			}
+			if (m_options.preserve_raw_elements) {
+				m_pending_raw = match_raw_element(text, i, false);
+			}
+		}
+		else if (c == '>' && !m_pending_raw.empty()) {
+			emit(c);
+			m_raw_element = move(m_pending_raw);
+			m_pending_raw.clear();
+			continue;
+		}
+
+		if (m_options.collapse_whitespace && isspace(static_cast<unsigned char>(c))) {
+			if (m_pending_space != '\n') {
+				m_pending_space = (c == '\n') ? '\n' : ' ';
+			}
+			continue;
+		}
+
+		emit(c);
+	}
+}
+
+void Minifier::emit(char c)
+{
+	if (m_pending_space != '\0') {
+		if (!m_output.empty()) {
+			m_output += m_pending_space;
+		}
+		m_pending_space = '\0';
+	}
+	m_output += c;
+}
+
+string_view Minifier::match_raw_element(string_view text, size_t pos, bool closing)
+{
+	// Elements whose content must not be touched
+	static constexpr string_view raw_elements[] = { "pre", "textarea", "script", "style" };
+
+	size_t name_start = pos + (closing ? 2 : 1);
+	if (closing && text.compare(pos, 2, "</") != 0) return {};
+
+	for (auto name : raw_elements) {
+		if (text.size() < name_start + name.size()) continue;
+		bool equal = true;
+		for (size_t i = 0; i < name.size() && equal; ++i) {
+			equal = tolower(static_cast<unsigned char>(text[name_start + i])) == name[i];
+		}
+		if (!equal) continue;
+
+		size_t after = name_start + name.size();
+		if (after == text.size() || text[after] == '>' || text[after] == '/' || isspace(static_cast<unsigned char>(text[after]))) {
+			return name;
+		}
+	}
+	return {};
+}
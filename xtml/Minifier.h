@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+/// <summary>
+/// Options for the output cleanup stage. The defaults match the former
+/// Core::clean_content (trim every line, drop leftover @var lines).
+/// </summary>
+struct MinifyOptions {
+	bool trim_lines = true;
+	bool strip_var_lines = true;
+	bool collapse_whitespace = false; // Collapse whitespace runs to one space (or one newline)
+	bool strip_comments = false; // Remove <!-- --> comments, conditional comments <!--[if ...]> are kept
+	bool preserve_raw_elements = false; // Leave <pre>, <textarea>, <script> and <style> content untouched
+
+	static MinifyOptions full() {
+		MinifyOptions options;
+		options.collapse_whitespace = true;
+		options.strip_comments = true;
+		options.preserve_raw_elements = true;
+		return options;
+	}
+};
+
+/// <summary>
+/// Streaming HTML whitespace and comment minifier. Input may be written in chunks
+/// of any size; it is processed in one linear pass.
+/// </summary>
+class Minifier
+{
+private:
+	MinifyOptions m_options;
+	std::string m_output;
+	std::string m_line; // Current, incomplete input line
+	std::string m_raw_element; // Name of the raw element we are inside of, if any
+	std::string m_pending_raw; // Raw element whose opening tag is being read
+	bool m_in_comment = false;
+	int m_comment_dashes = 0;
+	char m_pending_space = '\0';
+
+	void process_line(std::string_view line);
+	void emit_text(std::string_view text);
+	void emit(char c);
+	static std::string_view match_raw_element(std::string_view text, size_t pos, bool closing);
+
+public:
+	explicit Minifier(const MinifyOptions& options = MinifyOptions()) : m_options(options) {}
+
+	void write(std::string_view chunk);
+	std::string finish();
+
+	static std::string minify(std::string_view content, const MinifyOptions& options = MinifyOptions());
+};
@@ -0,0 +1,174 @@
+#include "ModuleLoader.h"
+#include "Module.h"
+#include "Utils.h"
+#include "Tracer.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <memory>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+typedef Module* (*CreateModuleFunc)();
+
+namespace {
+	struct ManifestEntry {
+		uintmax_t size = 0;
+		long long modified = 0;
+		vector<string> namespaces;
+	};
+
+	// One line per module: file, size, modification time and namespaces, separated by tabs
+	map<string, ManifestEntry> read_manifest(const string& path)
+	{
+		map<string, ManifestEntry> entries;
+		ifstream in(path);
+		string line;
+		while (getline(in, line)) {
+			auto fields = Utils::split(line, '\t');
+			if (fields.size() < 3 || !Utils::is_number(fields[1])) continue;
+			ManifestEntry entry;
+			entry.size = stoull(fields[1]);
+			entry.modified = stoll(fields[2]);
+			for (size_t i = 3; i < fields.size(); ++i) {
+				if (!fields[i].empty()) entry.namespaces.push_back(fields[i]);
+			}
+			entries[fields[0]] = move(entry);
+		}
+		return entries;
+	}
+
+	bool write_manifest(const string& path, const map<string, ManifestEntry>& entries)
+	{
+		ofstream out(path, ios::trunc);
+		if (!out.is_open()) return false;
+		for (auto& [file, entry] : entries) {
+			out << file << '\t' << entry.size << '\t' << entry.modified;
+			for (auto& ns : entry.namespaces) {
+				out << '\t' << ns;
+			}
+			out << '\n';
+		}
+		return out.good();
+	}
+}
+
+const char* ModuleLoader::extension()
+{
+#ifdef _WIN32
+	return ".dll";
+#else
+	return ".so";
+#endif
+}
+
+const char* ModuleLoader::manifest_name()
+{
+	return "modules.manifest";
+}
+
+bool ModuleLoader::load(const string& path, FunctionRegistry& registry)
+{
+	TraceSpan trace("module", Tracer::enabled() ? "load module " + path : string());
+#ifdef _WIN32
+	HMODULE handle = LoadLibraryA(path.c_str());
+	if (!handle) {
+		Utils::printerr_ln("Error: Could not load module " + path);
+		return false;
+	}
+	auto createModule = (CreateModuleFunc)GetProcAddress(handle, "CreateModule");
+	if (!createModule) {
+		Utils::printerr_ln("Error: CreateModule not found in " + path);
+		FreeLibrary(handle);
+		return false;
+	}
+#else
+	void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		Utils::printerr_ln("Error: Could not load module " + path + ": " + dlerror());
+		return false;
+	}
+	auto createModule = (CreateModuleFunc)dlsym(handle, "CreateModule");
+	if (!createModule) {
+		Utils::printerr_ln("Error: CreateModule not found in " + path);
+		dlclose(handle);
+		return false;
+	}
+#endif
+	// The library and module stay loaded for the lifetime of the process, the registered functions may refer to them
+	Module* plugin = createModule();
+	plugin->RegisterFunctions(registry);
+	return true;
+}
+
+void ModuleLoader::register_folder(const string& folder, FunctionRegistry& registry)
+{
+	error_code ec;
+	auto manifest_path = Utils::join_path(folder, manifest_name());
+	auto manifest = read_manifest(manifest_path);
+	map<string, ManifestEntry> current;
+	map<string, vector<string>> providers; // Namespace -> paths of the modules registering into it
+	auto loaded = make_shared<set<string>>(); // Module paths already loaded into registry
+
+	for (const auto& file : fs::directory_iterator(folder, ec)) {
+		if (file.path().extension() != extension()) continue;
+		auto name = file.path().filename().string();
+		auto path = file.path().string();
+		ManifestEntry entry;
+		entry.size = file.file_size(ec);
+		entry.modified = static_cast<long long>(file.last_write_time(ec).time_since_epoch().count());
+
+		auto cached = manifest.find(name);
+		if (cached != manifest.end() && cached->second.size == entry.size && cached->second.modified == entry.modified) {
+			entry.namespaces = cached->second.namespaces;
+		}
+		else {
+			// New or changed module: load it now and record every namespace it registers into, including
+			// namespaces it only extends (e.g. std), by loading it into a registry of its own first
+			FunctionRegistry staged;
+			if (!load(path, staged)) continue;
+			entry.namespaces = staged.NamespaceNames();
+			sort(entry.namespaces.begin(), entry.namespaces.end());
+			registry.Merge(staged);
+			loaded->insert(path);
+			Utils::log(LL_DEBUG, "Indexed module " + name);
+		}
+		for (auto& ns : entry.namespaces) {
+			providers[ns].push_back(path);
+		}
+		current[name] = move(entry);
+	}
+
+	if (current.size() != manifest.size() || !equal(current.begin(), current.end(), manifest.begin(), [](auto& a, auto& b) {
+		return a.first == b.first && a.second.size == b.second.size && a.second.modified == b.second.modified && a.second.namespaces == b.second.namespaces;
+	})) {
+		if (!write_manifest(manifest_path, current)) {
+			Utils::log(LL_DEBUG, "Could not write module manifest " + manifest_path);
+		}
+	}
+
+	if (!providers.empty()) {
+		// Called with the registry's publish mutex held, so loaded is never accessed concurrently
+		registry.SetNamespaceLoader([providers, loaded](string_view namespaceName, FunctionRegistry& target) {
+			auto it = providers.find(string(namespaceName));
+			if (it == providers.end()) return false;
+			bool any = false;
+			for (auto& path : it->second) {
+				if (!loaded->insert(path).second) continue;
+				if (Logger::enabled(LL_DEBUG)) Utils::log(LL_DEBUG, "Loading module " + path + " for " + string(namespaceName));
+				any = ModuleLoader::load(path, target) || any;
+			}
+			return any;
+		});
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include "FunctionRegistry.h"
+
+/// <summary>
+/// Loads module libraries (LoadLibrary on Windows, dlopen elsewhere). A module exports
+/// extern "C" Module* CreateModule(). Modules found in a folder are loaded when a template
+/// first calls into one of their namespaces; which library provides which namespace is
+/// cached in a manifest next to them, so only new or changed modules are loaded at startup.
+/// </summary>
+class ModuleLoader
+{
+public:
+	static const char* extension(); // ".dll" or ".so"
+	static const char* manifest_name();
+
+	// Load a module and register its functions, errors are reported and return false
+	static bool load(const std::string& path, FunctionRegistry& registry);
+	// Make the modules of folder available to registry, loading them on first use
+	static void register_folder(const std::string& folder, FunctionRegistry& registry);
+};
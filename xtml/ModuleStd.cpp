@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <cctype>
 #include "Utils.h"
+#include "Iterable.h"
 #include <chrono>
 #include <random>
 
@@ -78,7 +79,7 @@ void ModuleStd::RegisterFunctions(FunctionRegistry& registry)
 		}, 1, 1);
 
 	registry.RegisterFunction("std", "toStr", [](const vector<var>& args) -> var {
-		if (args.size() != 1 || args[0].type == DT_ARRAY) {
+		if (args.size() != 1 || args[0].type == DT_ARRAY || args[0].type == DT_ITERABLE || args[0].type == DT_OBJECT) {
 			Utils::printerr_ln("Error: std::toStr expects a single numeric argument.");
 			return var{ "", DT_UNKNOWN };
 		}
@@ -110,20 +111,44 @@ void ModuleStd::RegisterFunctions(FunctionRegistry& registry)
 		}, 1, 1);
 
 	registry.RegisterFunction("std", "get", [](const vector<var>& args) -> var {
+		if (args.size() == 2 && args[0].type == DT_ITERABLE && args[0].iterable && args[1].type == DT_NUMBER) {
+			// Lazy collections (e.g. JSON data files) are walked up to the index
+			int64_t index = std::stoll(args[1].value);
+			auto it = args[0].iterable->iterate();
+			var item;
+			for (int64_t i = 0; index >= 0 && it->next(item); ++i) {
+				if (i == index) return item;
+			}
+			Utils::throw_err("Error: std::get index out of bounds.");
+			return var{ "", DT_UNKNOWN };
+		}
 		if (args.size() != 2 && args[0].type != DT_ARRAY && args[1].type != DT_NUMBER) {
 			Utils::printerr_ln("Error: std::get expects an array and a numeric index as arguments.");
 			return var{ "", DT_UNKNOWN };
 		}
-		auto arr = args[0].array;
+		auto& arr = args[0].array;
 		int index = std::stoi(args[1].value);
 		if (index < 0 || index >= (int)arr.size()) {
 			Utils::throw_err("Error: std::get index out of bounds.");
 		}
-		auto value = arr[index];
-		return value;
+		return arr.at(index);
 		}, 2, 2);
 
 	registry.RegisterFunction("std", "count", [](const vector<var>& args) -> var {
+		if (args.size() == 1 && args[0].type == DT_ITERABLE && args[0].iterable && args[0].iterable->size() != VarIterable::unknown_size) {
+			return var{ std::to_string(args[0].iterable->size()), DT_NUMBER };
+		}
+		if (args.size() == 1 && args[0].type == DT_ITERABLE && args[0].iterable) {
+			// Size not known up front, count the elements without keeping them
+			size_t count = 0;
+			auto it = args[0].iterable->iterate();
+			var item;
+			while (it->next(item)) ++count;
+			return var{ std::to_string(count), DT_NUMBER };
+		}
+		if (args.size() == 1 && args[0].type == DT_OBJECT && args[0].object) {
+			return var{ std::to_string(args[0].object->size()), DT_NUMBER };
+		}
 		if (args.size() != 1 || args[0].type != DT_ARRAY) {
 			Utils::printerr_ln("Error: std::count expects a single array argument.");
 			return var{ "", DT_UNKNOWN };
@@ -131,6 +156,31 @@ void ModuleStd::RegisterFunctions(FunctionRegistry& registry)
 		return var{ std::to_string(args[0].array.size()), DT_NUMBER };
 		}, 1, 1);
 
+	registry.RegisterFunction("std", "range", [](const vector<var>& args) -> var {
+		// std::range(end), std::range(start, end) or std::range(start, end, step)
+		for (auto& arg : args) {
+			if (arg.type != DT_NUMBER) {
+				Utils::printerr_ln("Error: std::range expects numeric arguments.");
+				return var{ "", DT_UNKNOWN };
+			}
+		}
+		int64_t start = args.size() > 1 ? std::stoll(args[0].value) : 0;
+		int64_t end = std::stoll(args.size() > 1 ? args[1].value : args[0].value);
+		int64_t step = args.size() > 2 ? std::stoll(args[2].value) : 1;
+		return var{ "", DT_ITERABLE, {}, std::make_shared<RangeIterable>(start, end, step) };
+		}, 1, 3);
+
+	registry.RegisterFunction("std", "slice", [](const vector<var>& args) -> var {
+		// std::slice(array, start) or std::slice(array, start, end)
+		if (args[0].type != DT_ARRAY || args[1].type != DT_NUMBER || (args.size() == 3 && args[2].type != DT_NUMBER)) {
+			Utils::printerr_ln("Error: std::slice expects an array and numeric start and end indices.");
+			return var{ "", DT_UNKNOWN };
+		}
+		size_t start = std::stoull(args[1].value);
+		size_t end = args.size() == 3 ? std::stoull(args[2].value) : args[0].array.size();
+		return var{ "", DT_ITERABLE, {}, std::make_shared<SliceIterable>(args[0].array, start, end) };
+		}, 2, 3);
+
 	registry.RegisterFunction("std", "print", [](const vector<var>& args) -> var {
 		if (args.size() != 1) {
 			Utils::printerr_ln("Error: std::print expects a single argument.");
@@ -153,7 +203,7 @@ void ModuleStd::RegisterFunctions(FunctionRegistry& registry)
 			return var{ "", DT_UNKNOWN };
 		}
 
-		static std::mt19937 rng(seed);
+		thread_local std::mt19937 rng(seed);
 		std::uniform_int_distribution<int> dist(0, 61); // 62 chars in charset
 
 		const char charset[] =
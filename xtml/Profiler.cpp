@@ -0,0 +1,115 @@
+#include "Profiler.h"
+#include "Utils.h"
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+std::atomic<bool> Profiler::s_enabled(false);
+
+ProfileReport& Profiler::thread_report()
+{
+	thread_local ProfileReport report;
+	return report;
+}
+
+const char* Profiler::stage_name(ProfileStage stage)
+{
+	static const char* names[PS_COUNT] = {
+		"read_file",
+		"find_xtml_tags",
+		"resolve_include",
+		"parse_ast_statements",
+		"evaluate",
+		"resolve_placeholders",
+		"clean_content",
+		"remove_blocks",
+		"write_file",
+		"function_calls",
+	};
+	return names[stage];
+}
+
+uint64_t Profiler::wall_now_ns()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t Profiler::cpu_now_ns()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	auto to_ns = [](const FILETIME& time) { return ((uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100; };
+	return to_ns(kernel) + to_ns(user);
+#else
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return uint64_t(time.tv_sec) * 1000000000ull + time.tv_nsec;
+#endif
+}
+
+void ProfileReport::merge(const ProfileReport& other)
+{
+	total_wall_ns += other.total_wall_ns;
+	for (int i = 0; i < PS_COUNT; ++i) {
+		stages[i].calls += other.stages[i].calls;
+		stages[i].wall_ns += other.stages[i].wall_ns;
+		stages[i].cpu_ns += other.stages[i].cpu_ns;
+		stages[i].allocs += other.stages[i].allocs;
+		stages[i].alloc_bytes += other.stages[i].alloc_bytes;
+		if (other.stages[i].peak_bytes > stages[i].peak_bytes) stages[i].peak_bytes = other.stages[i].peak_bytes;
+	}
+	total_allocs += other.total_allocs;
+	total_alloc_bytes += other.total_alloc_bytes;
+	if (other.total_peak_bytes > total_peak_bytes) total_peak_bytes = other.total_peak_bytes;
+}
+
+void ProfileReport::print(const std::string& title) const
+{
+	bool memory = AllocProfiler::enabled();
+	char line[160];
+	snprintf(line, sizeof(line), "Profile: %s (%.3f ms)", title.c_str(), total_wall_ns / 1e6);
+	Utils::print_ln(line);
+	if (memory) {
+		snprintf(line, sizeof(line), "  %llu allocations, %.1f KB allocated, %.1f KB peak", (unsigned long long)total_allocs,
+			total_alloc_bytes / 1024.0, total_peak_bytes / 1024.0);
+		Utils::print_ln(line);
+	}
+	int used = snprintf(line, sizeof(line), "  %-22s %10s %12s %12s", "stage", "calls", "wall ms", "cpu ms");
+	if (memory) snprintf(line + used, sizeof(line) - used, " %10s %12s %10s", "allocs", "alloc KB", "peak KB");
+	Utils::print_ln(line);
+	for (int i = 0; i < PS_COUNT; ++i) {
+		auto& stage = stages[i];
+		used = snprintf(line, sizeof(line), "  %-22s %10llu %12.3f %12.3f", Profiler::stage_name(ProfileStage(i)),
+			(unsigned long long)stage.calls, stage.wall_ns / 1e6, stage.cpu_ns / 1e6);
+		if (memory) {
+			snprintf(line + used, sizeof(line) - used, " %10llu %12.1f %10.1f", (unsigned long long)stage.allocs,
+				stage.alloc_bytes / 1024.0, stage.peak_bytes / 1024.0);
+		}
+		Utils::print_ln(line);
+	}
+}
+
+void ProfileScope::start()
+{
+	m_wall_start = Profiler::wall_now_ns();
+	m_cpu_start = Profiler::cpu_now_ns();
+	m_memory = AllocProfiler::enabled();
+	if (m_memory) m_alloc.begin();
+}
+
+void ProfileScope::stop()
+{
+	auto& stage = Profiler::thread_report().stages[m_stage];
+	stage.calls++;
+	stage.wall_ns += Profiler::wall_now_ns() - m_wall_start;
+	stage.cpu_ns += Profiler::cpu_now_ns() - m_cpu_start;
+	if (m_memory) m_alloc.end(stage.allocs, stage.alloc_bytes, stage.peak_bytes);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "AllocProfiler.h"
+
+enum ProfileStage
+{
+	PS_READ_FILE,
+	PS_FIND_TAGS,
+	PS_RESOLVE_INCLUDE,
+	PS_PARSE_AST,
+	PS_EVALUATE,
+	PS_RESOLVE_PLACEHOLDERS,
+	PS_CLEAN_CONTENT,
+	PS_REMOVE_BLOCKS,
+	PS_WRITE_FILE,
+	PS_FUNCTION_CALL,
+	PS_COUNT
+};
+
+struct StageStats {
+	uint64_t calls = 0;
+	uint64_t wall_ns = 0;
+	uint64_t cpu_ns = 0;
+	// Heap use while the stage ran, recorded with --profile-memory
+	uint64_t allocs = 0;
+	uint64_t alloc_bytes = 0;
+	uint64_t peak_bytes = 0; // Highest growth of live heap over one call
+};
+
+/// <summary>
+/// Per-stage counters of one thread. Times are inclusive, e.g. resolve_include
+/// contains the read_file and evaluation time of the included file.
+/// </summary>
+struct ProfileReport {
+	StageStats stages[PS_COUNT];
+	uint64_t total_wall_ns = 0; // Whole build, set by the caller
+	uint64_t total_allocs = 0; // Whole build, set by the caller with --profile-memory
+	uint64_t total_alloc_bytes = 0;
+	uint64_t total_peak_bytes = 0;
+
+	void merge(const ProfileReport& other);
+	void print(const std::string& title) const;
+};
+
+/// <summary>
+/// Build instrumentation switched on with --profile. While disabled a probe
+/// costs one relaxed atomic load.
+/// </summary>
+class Profiler
+{
+private:
+	static std::atomic<bool> s_enabled;
+public:
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void set_enabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+	// Counters recorded on the calling thread
+	static ProfileReport& thread_report();
+	static const char* stage_name(ProfileStage stage);
+	static uint64_t wall_now_ns();
+	static uint64_t cpu_now_ns(); // CPU time of the calling thread
+};
+
+/// <summary>
+/// Records one call of a stage for the lifetime of the scope
+/// </summary>
+class ProfileScope
+{
+private:
+	ProfileStage m_stage;
+	bool m_active;
+	uint64_t m_wall_start = 0;
+	uint64_t m_cpu_start = 0;
+	bool m_memory = false;
+	AllocMark m_alloc;
+
+	void start();
+	void stop();
+public:
+	explicit ProfileScope(ProfileStage stage) : m_stage(stage), m_active(Profiler::enabled()) { if (m_active) start(); }
+	~ProfileScope() { if (m_active) stop(); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
@@ -0,0 +1,14 @@
+#include "RenderContext.h"
+#include "Globals.h"
+
+RenderContext& RenderContext::current()
+{
+	thread_local RenderContext context;
+	return context;
+}
+
+FunctionRegistry& RenderContext::function_registry()
+{
+	auto registry = current().registry;
+	return registry ? *registry : g_functionRegistry;
+}
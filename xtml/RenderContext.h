@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <functional>
+#include "Logger.h"
+
+class FunctionRegistry;
+struct MinifyOptions;
+struct BudgetLimits;
+
+typedef std::function<void(LogLevel level, const std::string& message)> LogFunc;
+
+/// <summary>
+/// Per-thread render settings. Unset fields fall back to the process wide
+/// defaults (g_functionRegistry, Core::minify_options, Budget::default_limits, Logger).
+/// </summary>
+struct RenderContext {
+	FunctionRegistry* registry = nullptr;
+	const MinifyOptions* minify_options = nullptr;
+	const LogFunc* log = nullptr;
+	const BudgetLimits* budget_limits = nullptr;
+
+	static RenderContext& current();
+	static FunctionRegistry& function_registry();
+};
+
+/// <summary>
+/// Installs a render context for the current thread and restores the previous one on destruction
+/// </summary>
+class RenderScope
+{
+private:
+	RenderContext m_previous;
+public:
+	explicit RenderScope(const RenderContext& context) : m_previous(RenderContext::current()) { RenderContext::current() = context; }
+	~RenderScope() { RenderContext::current() = m_previous; }
+
+	RenderScope(const RenderScope&) = delete;
+	RenderScope& operator=(const RenderScope&) = delete;
+};
@@ -0,0 +1,182 @@
+#include "Scanner.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define XTML_SCANNER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define XTML_TARGET_AVX2
+#else
+#define XTML_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+namespace {
+	typedef size_t (*FindEitherFunc)(const char* data, size_t size, char a, char b, size_t pos);
+	typedef size_t (*FindFirstOfFunc)(const char* data, size_t size, const char* set, size_t set_size, size_t pos);
+
+	size_t find_either_scalar(const char* data, size_t size, char a, char b, size_t pos)
+	{
+		for (; pos < size; ++pos) {
+			if (data[pos] == a || data[pos] == b) return pos;
+		}
+		return Scanner::npos;
+	}
+
+	size_t find_first_of_scalar(const char* data, size_t size, const char* set, size_t set_size, size_t pos)
+	{
+		for (; pos < size; ++pos) {
+			if (memchr(set, data[pos], set_size) != nullptr) return pos;
+		}
+		return Scanner::npos;
+	}
+
+#ifdef XTML_SCANNER_X86
+	inline unsigned count_trailing_zeros(unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	size_t find_either_sse2(const char* data, size_t size, char a, char b, size_t pos)
+	{
+		const __m128i va = _mm_set1_epi8(a);
+		const __m128i vb = _mm_set1_epi8(b);
+		for (; pos + 16 <= size; pos += 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+			__m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+			if (mask != 0) return pos + count_trailing_zeros(mask);
+		}
+		return find_either_scalar(data, size, a, b, pos);
+	}
+
+	size_t find_first_of_sse2(const char* data, size_t size, const char* set, size_t set_size, size_t pos)
+	{
+		__m128i needles[8];
+		for (size_t i = 0; i < set_size; ++i) needles[i] = _mm_set1_epi8(set[i]);
+		for (; pos + 16 <= size; pos += 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+			__m128i hits = _mm_setzero_si128();
+			for (size_t i = 0; i < set_size; ++i) hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[i]));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+			if (mask != 0) return pos + count_trailing_zeros(mask);
+		}
+		return find_first_of_scalar(data, size, set, set_size, pos);
+	}
+
+	XTML_TARGET_AVX2 size_t find_either_avx2(const char* data, size_t size, char a, char b, size_t pos)
+	{
+		const __m256i va = _mm256_set1_epi8(a);
+		const __m256i vb = _mm256_set1_epi8(b);
+		for (; pos + 32 <= size; pos += 32) {
+			__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+			__m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb));
+			unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+			if (mask != 0) return pos + count_trailing_zeros(mask);
+		}
+		return find_either_sse2(data, size, a, b, pos);
+	}
+
+	XTML_TARGET_AVX2 size_t find_first_of_avx2(const char* data, size_t size, const char* set, size_t set_size, size_t pos)
+	{
+		__m256i needles[8];
+		for (size_t i = 0; i < set_size; ++i) needles[i] = _mm256_set1_epi8(set[i]);
+		for (; pos + 32 <= size; pos += 32) {
+			__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+			__m256i hits = _mm256_setzero_si256();
+			for (size_t i = 0; i < set_size; ++i) hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needles[i]));
+			unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+			if (mask != 0) return pos + count_trailing_zeros(mask);
+		}
+		return find_first_of_sse2(data, size, set, set_size, pos);
+	}
+
+	bool cpu_has_avx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+		if (!os_saves_ymm) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	struct Dispatch {
+		FindEitherFunc find_either = find_either_scalar;
+		FindFirstOfFunc find_first_of = find_first_of_scalar;
+		const char* name = "scalar";
+
+		Dispatch() {
+#ifdef XTML_SCANNER_X86
+			if (cpu_has_avx2()) {
+				find_either = find_either_avx2;
+				find_first_of = find_first_of_avx2;
+				name = "avx2";
+			}
+			else {
+				find_either = find_either_sse2;
+				find_first_of = find_first_of_sse2;
+				name = "sse2";
+			}
+#endif
+		}
+	};
+
+	const Dispatch& dispatch()
+	{
+		static const Dispatch instance;
+		return instance;
+	}
+}
+
+size_t Scanner::find_either(string_view text, char a, char b, size_t pos)
+{
+	if (pos >= text.size()) return npos;
+	return dispatch().find_either(text.data(), text.size(), a, b, pos);
+}
+
+size_t Scanner::find_first_of(string_view text, string_view set, size_t pos)
+{
+	if (pos >= text.size() || set.empty()) return npos;
+	if (set.size() > 8) {
+		size_t found = text.find_first_of(set, pos);
+		return found == string_view::npos ? npos : found;
+	}
+	return dispatch().find_first_of(text.data(), text.size(), set.data(), set.size(), pos);
+}
+
+size_t Scanner::find(string_view text, string_view needle, size_t pos)
+{
+	if (needle.empty()) return pos <= text.size() ? pos : npos;
+
+	// Jump between candidates for the first byte, then compare the rest
+	char first = needle[0];
+	while ((pos = find_either(text, first, first, pos)) != npos) {
+		if (text.size() - pos < needle.size()) return npos;
+		if (memcmp(text.data() + pos + 1, needle.data() + 1, needle.size() - 1) == 0) return pos;
+		++pos;
+	}
+	return npos;
+}
+
+const char* Scanner::implementation()
+{
+	return dispatch().name;
+}
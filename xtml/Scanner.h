@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+/// <summary>
+/// Vectorized byte search used for tag and placeholder discovery. Uses AVX2 or
+/// SSE2 when the CPU supports it (selected once at runtime), otherwise a scalar loop.
+/// </summary>
+class Scanner
+{
+public:
+	static constexpr size_t npos = std::string_view::npos;
+
+	// Position of the next occurrence of a or b at or after pos
+	static size_t find_either(std::string_view text, char a, char b, size_t pos = 0);
+	// Position of the next '<' or '{', i.e. the next byte that can start markup
+	static size_t find_markup(std::string_view text, size_t pos = 0) { return find_either(text, '<', '{', pos); }
+	// Position of the next byte contained in set (at most 8 bytes) at or after pos
+	static size_t find_first_of(std::string_view text, std::string_view set, size_t pos = 0);
+	// Position of the next occurrence of needle at or after pos
+	static size_t find(std::string_view text, std::string_view needle, size_t pos = 0);
+	// Name of the selected implementation ("avx2", "sse2" or "scalar")
+	static const char* implementation();
+};
@@ -0,0 +1,341 @@
+#include "Shadow.h"
+#include "Engine.h"
+#include "Core.h"
+#include "Utils.h"
+#include "Profiler.h"
+#include "RenderContext.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace xtml {
+
+	namespace {
+		const size_t excerpt_radius = 24;
+
+		// Printable excerpt of text around offset, control characters escaped
+		string excerpt(string_view text, size_t offset)
+		{
+			size_t start = offset > excerpt_radius ? offset - excerpt_radius : 0;
+			size_t end = min(text.size(), offset + excerpt_radius);
+			string result;
+			for (size_t i = start; i < end; ++i) {
+				if (i == offset) result += "\xc2\xbb"; // Marks the first differing byte
+				char c = text[i];
+				if (c == '\n') result += "\\n";
+				else if (c == '\r') result += "\\r";
+				else if (c == '\t') result += "\\t";
+				else result += c;
+			}
+			if (offset >= end) result += "\xc2\xbb<end>";
+			return result;
+		}
+
+		// Runs render and stores its output or error and the elapsed wall time
+		void timed_render(const RenderFunc& render, const string& path, const VarMap& vars, string& output, string& error, uint64_t& elapsed_ns)
+		{
+			auto start = Profiler::wall_now_ns();
+			try {
+				output = render(path, vars);
+			}
+			catch (const exception& e) {
+				error = e.what();
+				if (error.empty()) error = "unknown error";
+			}
+			elapsed_ns = Profiler::wall_now_ns() - start;
+		}
+	}
+
+	string ShadowResult::describe() const
+	{
+		char timing[96];
+		snprintf(timing, sizeof(timing), "legacy %.3f ms, candidate %.3f ms", legacy_ns / 1e6, candidate_ns / 1e6);
+		if (identical) {
+			return path + ": identical (" + timing + ")";
+		}
+		if (!legacy_error.empty() || !candidate_error.empty()) {
+			return path + ": results differ (" + timing + ")\n"
+				+ "  legacy:    " + (legacy_error.empty() ? "ok, " + to_string(legacy_size) + " bytes" : "error: " + legacy_error) + "\n"
+				+ "  candidate: " + (candidate_error.empty() ? "ok, " + to_string(candidate_size) + " bytes" : "error: " + candidate_error);
+		}
+		return path + ": first divergence at offset " + to_string(offset) + " (line " + to_string(line) + ", column " + to_string(column)
+			+ "; " + to_string(legacy_size) + " vs " + to_string(candidate_size) + " bytes; " + timing + ")\n"
+			+ "  legacy:    " + legacy_excerpt + "\n"
+			+ "  candidate: " + candidate_excerpt;
+	}
+
+	/// <summary>
+	/// The production path: the process wide registry and minify options, as used by xtml build
+	/// </summary>
+	RenderFunc Shadow::legacy_renderer()
+	{
+		return [](const string& path, const VarMap& vars) {
+			VarMap local_vars = vars;
+			return Core::build_file(path, local_vars);
+		};
+	}
+
+	/// <summary>
+	/// The compiled path: templates parsed once by Engine::compile, evaluated by Engine::render
+	/// </summary>
+	RenderFunc Shadow::engine_renderer(Engine& engine)
+	{
+		return [&engine](const string& path, const VarMap& vars) {
+			auto tpl = engine.compile(path);
+			return engine.render(*tpl, vars);
+		};
+	}
+
+	size_t Shadow::first_difference(string_view a, string_view b)
+	{
+		auto mismatch = std::mismatch(a.begin(), a.begin() + min(a.size(), b.size()), b.begin());
+		return static_cast<size_t>(mismatch.first - a.begin());
+	}
+
+	ShadowResult Shadow::compare(const string& path, const VarMap& vars, const RenderFunc& legacy, const RenderFunc& candidate)
+	{
+		ShadowResult result;
+		result.path = path;
+		string legacy_output, candidate_output;
+
+		{
+			// Build messages of the legacy path would interleave with the report
+			LogFunc silent = [](LogLevel, const string&) {};
+			RenderContext context = RenderContext::current();
+			context.log = &silent;
+			RenderScope scope(context);
+			timed_render(legacy, path, vars, legacy_output, result.legacy_error, result.legacy_ns);
+		}
+		timed_render(candidate, path, vars, candidate_output, result.candidate_error, result.candidate_ns);
+
+		result.legacy_size = legacy_output.size();
+		result.candidate_size = candidate_output.size();
+		if (!result.legacy_error.empty() || !result.candidate_error.empty()) {
+			result.identical = result.legacy_error == result.candidate_error;
+			return result;
+		}
+
+		result.offset = first_difference(legacy_output, candidate_output);
+		result.identical = result.offset == legacy_output.size() && legacy_output.size() == candidate_output.size();
+		if (!result.identical) {
+			auto line_start = legacy_output.rfind('\n', result.offset == 0 ? 0 : result.offset - 1);
+			result.line = 1 + std::count(legacy_output.begin(), legacy_output.begin() + result.offset, '\n');
+			result.column = line_start == string::npos || result.offset == 0 ? result.offset + 1 : result.offset - line_start;
+			result.legacy_excerpt = excerpt(legacy_output, result.offset);
+			result.candidate_excerpt = excerpt(candidate_output, result.offset);
+		}
+		return result;
+	}
+
+	namespace {
+		/// <summary>
+		/// Random template generator. Only references variables it has defined, so pages
+		/// are expected to render; any that fail still have to fail the same way on both paths.
+		/// </summary>
+		class FuzzWriter
+		{
+		private:
+			mt19937& m_rng;
+			vector<string> m_strings;
+			vector<string> m_numbers;
+			vector<string> m_arrays;
+			size_t m_next = 0;
+
+			size_t pick(size_t n) { return n ? m_rng() % n : 0; }
+			bool chance(int percent) { return static_cast<int>(m_rng() % 100) < percent; }
+
+			string text(size_t max_length)
+			{
+				static const char alphabet[] = "abcdefgh XYZ 0123 .,;:-_!?&<>'=/%#";
+				string result;
+				size_t length = 1 + pick(max_length);
+				for (size_t i = 0; i < length; ++i) {
+					result += alphabet[pick(sizeof(alphabet) - 1)];
+				}
+				return result;
+			}
+
+			// Attribute values of xtml tags must not contain '>', so they get plain words
+			string word()
+			{
+				static const char* words[] = { "alpha", "beta", "gamma", "delta", "omega" };
+				return words[pick(5)];
+			}
+
+			string string_literal() { return "\"" + text(12) + "\""; }
+			string number_literal() { return to_string(pick(1000)); }
+
+			string string_expr()
+			{
+				switch (pick(4)) {
+				case 0: if (!m_strings.empty()) return m_strings[pick(m_strings.size())] + " + " + string_literal(); break;
+				case 1: if (!m_strings.empty()) return "std::toUpper(" + m_strings[pick(m_strings.size())] + ")"; break;
+				case 2: if (!m_numbers.empty()) return string_literal() + " + " + m_numbers[pick(m_numbers.size())]; break;
+				}
+				return string_literal();
+			}
+
+			string number_expr()
+			{
+				switch (pick(4)) {
+				case 0: if (!m_numbers.empty()) return m_numbers[pick(m_numbers.size())] + " + " + number_literal(); break;
+				case 1: if (!m_strings.empty()) return "std::len(" + m_strings[pick(m_strings.size())] + ")"; break;
+				case 2: if (!m_arrays.empty()) return "std::count(" + m_arrays[pick(m_arrays.size())] + ")"; break;
+				}
+				return number_literal();
+			}
+
+			string array_expr()
+			{
+				string result = "[";
+				size_t count = 1 + pick(6);
+				for (size_t i = 0; i < count; ++i) {
+					if (i) result += ", ";
+					result += chance(50) ? string_literal() : number_literal();
+				}
+				return result + "]";
+			}
+
+			string condition()
+			{
+				static const char* ops[] = { ">", "<", "==", "!=", ">=", "<=" };
+				if (!m_numbers.empty()) {
+					auto clause = m_numbers[pick(m_numbers.size())] + " " + ops[pick(6)] + " " + number_literal();
+					if (chance(30) && m_numbers.size() > 1) {
+						clause += (chance(50) ? " && " : " || ") + m_numbers[pick(m_numbers.size())] + " " + ops[pick(6)] + " " + number_literal();
+					}
+					return clause;
+				}
+				return number_literal() + " " + ops[pick(6)] + " " + number_literal();
+			}
+
+			string statement(int depth)
+			{
+				auto name = "v" + to_string(m_next++);
+				int kind = depth > 0 ? static_cast<int>(pick(3)) : static_cast<int>(pick(7));
+				// Expressions are built before the new name is added, so a variable never references itself
+				switch (kind) {
+				case 0: { auto value = string_expr(); m_strings.push_back(name); return "@var " + name + " = " + value + ";"; }
+				case 1: { auto value = number_expr(); m_numbers.push_back(name); return "@var " + name + " = " + value + ";"; }
+				case 2: { auto value = array_expr(); m_arrays.push_back(name); return "@var " + name + " = " + value + ";"; }
+				case 3: {
+					// Assigns the same variable in both branches so later references stay defined
+					auto test = condition();
+					auto then_value = string_expr();
+					auto else_value = string_expr();
+					m_strings.push_back(name);
+					return "@if (" + test + ") { @var " + name + " = " + then_value + "; } @else { @var " + name + " = " + else_value + "; }";
+				}
+				case 4: {
+					if (m_arrays.empty()) break;
+					auto source = m_arrays[pick(m_arrays.size())];
+					m_strings.push_back(name);
+					return "@var " + name + " = \"\";\n\t@foreach (item in " + source + ") { @var " + name + " = " + name + " + item + \",\"; }";
+				}
+				case 5: {
+					m_numbers.push_back(name);
+					return "@var " + name + " = 0;\n\t@foreach (k in std::range(" + to_string(pick(12)) + ")) { @var " + name + " = " + name + " + k; }";
+				}
+				case 6: {
+					// Variables set inside the branch may stay undefined, so they are not referenced later
+					auto test = condition();
+					auto strings = m_strings.size(), numbers = m_numbers.size(), arrays = m_arrays.size();
+					auto inner = statement(depth + 1);
+					m_strings.resize(strings);
+					m_numbers.resize(numbers);
+					m_arrays.resize(arrays);
+					return "@if (" + test + ") { " + inner + " }";
+				}
+				}
+				m_numbers.push_back(name);
+				return "@var " + name + " = " + number_literal() + ";";
+			}
+
+			string placeholder()
+			{
+				static const char* filters[] = { "", "", "|html", "|attr", "|url", "|raw" };
+				auto& pool = m_numbers.empty() || (!m_strings.empty() && chance(60)) ? m_strings : m_numbers;
+				if (pool.empty()) return text(8);
+				return "{{@" + pool[pick(pool.size())] + filters[pick(6)] + "}}";
+			}
+
+		public:
+			explicit FuzzWriter(mt19937& rng) : m_rng(rng) {}
+
+			string page(size_t partials)
+			{
+				string content;
+				if (chance(20)) content += "<xtml escape=\"html\" />\n";
+				size_t blocks = 1 + pick(3);
+				for (size_t b = 0; b < blocks; ++b) {
+					string block = "<xtml>\n";
+					size_t statements = 1 + pick(8);
+					for (size_t s = 0; s < statements; ++s) {
+						block += "\t" + statement(0) + "\n";
+					}
+					block += "</xtml>\n";
+					content += block;
+					if (chance(10)) {
+						// Identical blocks all receive the output of the first one
+						content += block;
+					}
+
+					size_t lines = 1 + pick(6);
+					for (size_t l = 0; l < lines; ++l) {
+						switch (pick(5)) {
+						case 0: content += "<!-- " + text(10) + " -->\n"; break;
+						case 1:
+							if (partials) {
+								content += "<xtml include=\"inc" + to_string(pick(partials)) + ".xtml\" param-label=\"" + word() + "\" />\n";
+								break;
+							}
+							[[fallthrough]];
+						default: content += "<p class=\"" + text(4) + "\">" + text(16) + " " + placeholder() + "</p>\n"; break;
+						}
+					}
+				}
+				return content;
+			}
+
+			string partial()
+			{
+				auto name = "p" + to_string(m_next++);
+				m_strings.push_back(name);
+				return "<xtml>\n\t@var " + name + " = " + string_literal() + " + label;\n</xtml>\n<div>{{@" + name + "|html}} {{@label}}</div>\n";
+			}
+		};
+
+		void write_text(const fs::path& path, const string& content)
+		{
+			ofstream out(path, ios::binary);
+			if (!out) Utils::throw_err("Could not create file: " + path.string());
+			out << content;
+		}
+	}
+
+	vector<string> Shadow::generate_fuzz_corpus(const string& dir, size_t count, unsigned seed)
+	{
+		mt19937 rng(seed);
+		fs::create_directories(dir);
+
+		const size_t partials = 3;
+		for (size_t i = 0; i < partials; ++i) {
+			FuzzWriter writer(rng);
+			write_text(fs::path(dir) / ("inc" + to_string(i) + ".xtml"), writer.partial());
+		}
+
+		vector<string> pages;
+		for (size_t i = 0; i < count; ++i) {
+			FuzzWriter writer(rng);
+			auto path = (fs::path(dir) / ("fuzz" + to_string(i) + ".xtml")).string();
+			write_text(path, writer.page(partials));
+			pages.push_back(path);
+		}
+		return pages;
+	}
+}
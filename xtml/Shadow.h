@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "Vars.h"
+
+namespace xtml {
+
+	class Engine;
+
+	// Renders the template file at path with a copy of vars and returns the output
+	typedef std::function<std::string(const std::string& path, const VarMap& vars)> RenderFunc;
+
+	/// <summary>
+	/// Outcome of rendering one page through the legacy and the candidate path
+	/// </summary>
+	struct ShadowResult {
+		std::string path;
+		bool identical = false;
+		size_t offset = 0; // First differing byte
+		size_t line = 0; // 1-based line and column of offset in the legacy output
+		size_t column = 0;
+		std::string legacy_excerpt; // Output around offset
+		std::string candidate_excerpt;
+		std::string legacy_error; // Exception message, empty if the render succeeded
+		std::string candidate_error;
+		size_t legacy_size = 0;
+		size_t candidate_size = 0;
+		uint64_t legacy_ns = 0;
+		uint64_t candidate_ns = 0;
+
+		std::string describe() const;
+	};
+
+	/// <summary>
+	/// Differential validation: renders pages through the current Core::build_file path and a
+	/// candidate renderer, and reports where their outputs first diverge. Failures count as
+	/// identical when both paths fail with the same message. The default candidate is Engine,
+	/// which evaluates compiled templates instead of rewriting the source text.
+	/// </summary>
+	class Shadow
+	{
+	public:
+		static RenderFunc legacy_renderer();
+		static RenderFunc engine_renderer(Engine& engine);
+
+		static ShadowResult compare(const std::string& path, const VarMap& vars, const RenderFunc& legacy, const RenderFunc& candidate);
+		static size_t first_difference(std::string_view a, std::string_view b);
+
+		// Writes count random pages (plus shared partials) into dir and returns the page paths
+		static std::vector<std::string> generate_fuzz_corpus(const std::string& dir, size_t count, unsigned seed);
+	};
+}
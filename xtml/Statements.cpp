@@ -151,7 +151,7 @@ std::vector<std::string> Statements::tokenize_condition(const std::string& condi
 /// <param name="ops"></param>
 /// <param name="vars"></param>
 /// <returns></returns>
-bool Statements::resolve_conditions(const std::vector<std::string>& conditions, const std::vector<ConditionOp>& ops, const std::map<std::string, var>& vars)
+bool Statements::resolve_conditions(const std::vector<std::string>& conditions, const std::vector<ConditionOp>& ops, const VarMap& vars)
 {
 	if (conditions.empty()) return false;
 	if (conditions.size() != ops.size() + 1) {
@@ -186,23 +186,38 @@ bool Statements::resolve_conditions(const std::vector<std::string>& conditions,
 /// <param name="condition"></param>
 /// <param name="vars"></param>
 /// <returns></returns>
-bool Statements::resolve_condition(const std::string& condition, const std::map<std::string, var>& vars)
+bool Statements::resolve_condition(const std::string& condition, const VarMap& vars)
 {
-	bool result = false;
 	auto tokens = tokenize_condition(condition);
 	var left, right;
 
 	if (tokens.size() != 3) {
 		// Multi-part condition resolve
 		auto conds = split_conditions(condition);
+		if (conds.size() == 1 && conds[0] == condition) {
+			// Nothing left to split, resolving it again would recurse forever
+			Utils::throw_err("Error: Invalid condition: " + condition);
+			return false;
+		}
 		auto cond_ops = parse_condition_ops(condition);
 		return resolve_conditions(conds, cond_ops, vars);
 	}
 
 	left = Vars::eval_expr(tokens[0], vars);
 	right = Vars::eval_expr(tokens[2], vars);
-	std::string op = tokens[1];
+	return compare(left, tokens[1], right, condition);
+}
 
+/// <summary>
+/// Compare the operands of a "left op right" condition
+/// </summary>
+/// <param name="left"></param>
+/// <param name="op"></param>
+/// <param name="right"></param>
+/// <param name="condition"></param>
+/// <returns></returns>
+bool Statements::compare(const var& left, const std::string& op, const var& right, const std::string& condition)
+{
 	if (left.type == DT_UNKNOWN || right.type == DT_UNKNOWN) {
 		Utils::throw_err("Error: Unknown variable in condition: " + condition);
 		return false;
@@ -244,7 +259,7 @@ bool Statements::resolve_condition(const std::string& condition, const std::map<
 }
 
 
-bool Statements::evaluate_condition(const std::string& condition_str, const std::string& content_str, std::map<std::string, var>& vars)
+bool Statements::evaluate_condition(const std::string& condition_str, const std::string& content_str, VarMap& vars)
 {
 	auto condition = Utils::trim(condition_str);
 	if (condition.empty()) {
@@ -262,3 +277,71 @@ bool Statements::evaluate_condition(const std::string& condition_str, const std:
 	}
 	return false;
 }
+
+/// <summary>
+/// Split a condition once so evaluating it only evaluates its operands
+/// </summary>
+/// <param name="condition_str"></param>
+/// <returns></returns>
+CompiledCondition Statements::compile_condition(const std::string& condition_str)
+{
+	CompiledCondition compiled;
+	compiled.text = Utils::trim(condition_str);
+	if (compiled.text.empty()) {
+		// Reported when the condition is evaluated, like before
+		return compiled;
+	}
+
+	compiled.ops = parse_condition_ops(compiled.text);
+	for (auto& condition : split_conditions(compiled.text)) {
+		CompiledCondition::Part part;
+		part.text = Utils::trim(condition);
+		auto tokens = tokenize_condition(part.text);
+		if (tokens.size() == 3) {
+			part.compiled = true;
+			part.left = Vars::compile_expr(tokens[0]);
+			part.op = tokens[1];
+			part.right = Vars::compile_expr(tokens[2]);
+		}
+		compiled.parts.push_back(std::move(part));
+	}
+	return compiled;
+}
+
+bool Statements::evaluate_condition(const CompiledCondition& condition, VarMap& vars)
+{
+	if (condition.text.empty()) {
+		Utils::throw_err("Error: Empty condition in if statement.");
+		return false;
+	}
+	if (condition.parts.empty()) return false;
+	if (condition.parts.size() != condition.ops.size() + 1) {
+		Utils::throw_err("Error: Mismatched conditions and operators.");
+		return false;
+	}
+
+	// Every part is resolved before they are combined, as resolve_conditions does
+	std::vector<bool> cond_results;
+	cond_results.reserve(condition.parts.size());
+	for (auto& part : condition.parts) {
+		if (part.compiled) {
+			auto left = Vars::eval_expr(part.left, vars);
+			auto right = Vars::eval_expr(part.right, vars);
+			cond_results.push_back(compare(left, part.op, right, part.text));
+		}
+		else {
+			cond_results.push_back(resolve_condition(part.text, vars));
+		}
+	}
+
+	bool final_result = cond_results[0];
+	for (size_t i = 0; i < condition.ops.size(); ++i) {
+		if (condition.ops[i] == OP_AND) {
+			final_result = final_result && cond_results[i + 1];
+		}
+		else if (condition.ops[i] == OP_OR) {
+			final_result = final_result || cond_results[i + 1];
+		}
+	}
+	return final_result;
+}
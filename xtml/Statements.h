@@ -13,15 +13,35 @@ enum ConditionOp {
 	OP_NONE
 };
 
+/// <summary>
+/// A condition split into its parts and operators when its AST node is built. Simple comparisons
+/// keep their operands as compiled expressions, other parts are resolved from their text.
+/// </summary>
+struct CompiledCondition {
+	struct Part {
+		std::string text;
+		bool compiled = false; // "left op right", evaluated through left/right
+		CompiledExpr left;
+		std::string op;
+		CompiledExpr right;
+	};
+	std::string text;
+	std::vector<Part> parts;
+	std::vector<ConditionOp> ops;
+};
+
 class Statements
 {
-	
+	static bool compare(const var& left, const std::string& op, const var& right, const std::string& condition);
+
 public:
 	static std::vector<std::string> split_conditions(const std::string& condition);
 	static std::vector<ConditionOp> parse_condition_ops(const std::string& condition);
 	static std::vector<std::string> tokenize_condition(const std::string& condition);
-	static bool resolve_conditions(const std::vector<std::string>& conditions, const std::vector<ConditionOp>& ops, const std::map<std::string, var>& vars);
-	static bool resolve_condition(const std::string& condition, const std::map<std::string, var>& vars);
-	static bool evaluate_condition(const std::string& condition_str, const std::string& content_str, std::map<std::string, var>& vars);
+	static bool resolve_conditions(const std::vector<std::string>& conditions, const std::vector<ConditionOp>& ops, const VarMap& vars);
+	static bool resolve_condition(const std::string& condition, const VarMap& vars);
+	static bool evaluate_condition(const std::string& condition_str, const std::string& content_str, VarMap& vars);
+	static CompiledCondition compile_condition(const std::string& condition_str);
+	static bool evaluate_condition(const CompiledCondition& condition, VarMap& vars);
 };
 
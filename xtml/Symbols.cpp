@@ -0,0 +1,60 @@
+#include "Symbols.h"
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include "Utils.h"
+
+using namespace std;
+
+namespace {
+	struct SymbolTable {
+		shared_mutex mutex;
+		deque<string> names{ "" }; // Index 0 is Symbols::none, deque keeps the views below stable
+		unordered_map<string_view, Symbol> ids;
+	};
+
+	SymbolTable& table()
+	{
+		static SymbolTable instance;
+		return instance;
+	}
+}
+
+Symbol Symbols::intern(string_view name)
+{
+	auto& symbols = table();
+	{
+		shared_lock lock(symbols.mutex);
+		if (auto it = symbols.ids.find(name); it != symbols.ids.end()) {
+			return it->second;
+		}
+	}
+
+	unique_lock lock(symbols.mutex);
+	if (auto it = symbols.ids.find(name); it != symbols.ids.end()) {
+		return it->second;
+	}
+	Symbol id = static_cast<Symbol>(symbols.names.size());
+	symbols.names.emplace_back(name);
+	symbols.ids.emplace(symbols.names.back(), id);
+	return id;
+}
+
+Symbol Symbols::find(string_view name)
+{
+	auto& symbols = table();
+	shared_lock lock(symbols.mutex);
+	auto it = symbols.ids.find(name);
+	return it != symbols.ids.end() ? it->second : none;
+}
+
+const string& Symbols::name(Symbol symbol)
+{
+	auto& symbols = table();
+	shared_lock lock(symbols.mutex);
+	if (symbol >= symbols.names.size()) {
+		Utils::throw_err("Error: Unknown symbol id: " + to_string(symbol));
+	}
+	return symbols.names[symbol];
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+typedef uint32_t Symbol;
+
+/// <summary>
+/// Global, thread-safe interner for identifiers (variable, namespace and function names).
+/// Every distinct name maps to one small integer id for the lifetime of the process.
+/// </summary>
+class Symbols
+{
+public:
+	static constexpr Symbol none = 0;
+
+	static Symbol intern(std::string_view name);
+	static Symbol find(std::string_view name); // Returns Symbols::none if the name was never interned
+	static const std::string& name(Symbol symbol);
+};
@@ -0,0 +1,216 @@
+#include "TemplateProfiler.h"
+#include "Profiler.h"
+#include "AllocProfiler.h"
+#include "Utils.h"
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+std::atomic<bool> TemplateProfiler::s_enabled(false);
+
+namespace {
+	struct FrameNode {
+		string name;
+		FrameNode* parent = nullptr;
+		uint64_t calls = 0;
+		uint64_t inclusive_ns = 0;
+		uint64_t allocs = 0; // Inclusive, recorded with --profile-memory
+		uint64_t alloc_bytes = 0;
+		uint64_t peak_bytes = 0;
+		map<string, unique_ptr<FrameNode>, less<>> children;
+	};
+
+	struct ThreadState {
+		FrameNode root;
+		FrameNode* current = &root;
+		vector<uint64_t> starts;
+		vector<AllocMark> marks; // Parallel to starts while memory is profiled
+		string file;
+		size_t line = 0;
+	};
+
+	ThreadState& state()
+	{
+		thread_local ThreadState instance;
+		return instance;
+	}
+
+	uint64_t exclusive_ns(const FrameNode& node)
+	{
+		uint64_t children = 0;
+		for (auto& [name, child] : node.children) {
+			children += child->inclusive_ns;
+		}
+		return node.inclusive_ns > children ? node.inclusive_ns - children : 0;
+	}
+
+	void write_node(ostream& out, const FrameNode& node, const string& stack)
+	{
+		auto path = stack.empty() ? node.name : stack + ";" + node.name;
+		uint64_t micros = exclusive_ns(node) / 1000;
+		if (micros > 0) {
+			out << path << " " << micros << "\n";
+		}
+		for (auto& [name, child] : node.children) {
+			write_node(out, *child, path);
+		}
+	}
+
+	struct FrameTotals {
+		uint64_t calls = 0;
+		uint64_t inclusive_ns = 0;
+		uint64_t exclusive_ns = 0;
+		uint64_t allocs = 0;
+		uint64_t alloc_bytes = 0;
+		uint64_t peak_bytes = 0;
+	};
+
+	void collect_totals(const FrameNode& node, map<string, FrameTotals>& totals, vector<const string*>& active)
+	{
+		auto& entry = totals[node.name];
+		entry.calls += node.calls;
+		entry.exclusive_ns += exclusive_ns(node);
+		// Recursive frames (e.g. an include inside itself) only count the outermost inclusive time
+		if (find_if(active.begin(), active.end(), [&](const string* name) { return *name == node.name; }) == active.end()) {
+			entry.inclusive_ns += node.inclusive_ns;
+			entry.allocs += node.allocs;
+			entry.alloc_bytes += node.alloc_bytes;
+		}
+		entry.peak_bytes = max(entry.peak_bytes, node.peak_bytes);
+		active.push_back(&node.name);
+		for (auto& [name, child] : node.children) {
+			collect_totals(*child, totals, active);
+		}
+		active.pop_back();
+	}
+}
+
+void TemplateProfiler::enter(const string& frame)
+{
+	auto& s = state();
+	auto it = s.current->children.find(frame);
+	if (it == s.current->children.end()) {
+		auto node = make_unique<FrameNode>();
+		node->name = frame;
+		node->parent = s.current;
+		it = s.current->children.emplace(frame, move(node)).first;
+	}
+	s.current = it->second.get();
+	s.current->calls++;
+	if (AllocProfiler::enabled()) {
+		s.marks.emplace_back().begin();
+	}
+	s.starts.push_back(Profiler::wall_now_ns());
+}
+
+void TemplateProfiler::leave()
+{
+	auto& s = state();
+	if (s.starts.empty()) return;
+	s.current->inclusive_ns += Profiler::wall_now_ns() - s.starts.back();
+	s.starts.pop_back();
+	if (s.marks.size() > s.starts.size()) {
+		s.marks.back().end(s.current->allocs, s.current->alloc_bytes, s.current->peak_bytes);
+		s.marks.pop_back();
+	}
+	s.current = s.current->parent;
+}
+
+void TemplateProfiler::reset()
+{
+	auto& s = state();
+	s.root.children.clear();
+	s.current = &s.root;
+	s.starts.clear();
+	s.marks.clear();
+}
+
+const string& TemplateProfiler::current_file()
+{
+	return state().file;
+}
+
+void TemplateProfiler::set_file(const string& file)
+{
+	state().file = file;
+}
+
+size_t TemplateProfiler::current_line()
+{
+	return state().line;
+}
+
+void TemplateProfiler::set_line(size_t line)
+{
+	state().line = line;
+}
+
+string TemplateProfiler::frame_label(string_view statement)
+{
+	// Statement head up to its body, ';' is the stack separator of the collapsed format
+	auto head = Utils::trim_view(statement.substr(0, statement.find('{')));
+	if (!head.empty() && head.back() == ';') {
+		head = Utils::trim_view(head.substr(0, head.size() - 1));
+	}
+	string label(head.substr(0, 60));
+	if (head.size() > 60) label += "...";
+	replace(label.begin(), label.end(), ';', ',');
+	return Utils::file_name(current_file()) + ":" + to_string(current_line()) + " " + label;
+}
+
+void TemplateProfiler::write_collapsed(ostream& out)
+{
+	for (auto& [name, child] : state().root.children) {
+		write_node(out, *child, "");
+	}
+}
+
+void TemplateProfiler::print_summary(size_t max_rows)
+{
+	map<string, FrameTotals> totals;
+	vector<const string*> active;
+	for (auto& [name, child] : state().root.children) {
+		collect_totals(*child, totals, active);
+	}
+
+	vector<pair<string, FrameTotals>> rows(totals.begin(), totals.end());
+	sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.second.exclusive_ns > b.second.exclusive_ns; });
+	if (rows.size() > max_rows) rows.resize(max_rows);
+
+	bool memory = AllocProfiler::enabled();
+	char line[128];
+	Utils::print_ln("Template profile (top frames by exclusive time)");
+	int used = snprintf(line, sizeof(line), "  %10s %12s %12s", "calls", "incl ms", "excl ms");
+	if (memory) snprintf(line + used, sizeof(line) - used, " %10s %12s %10s", "allocs", "alloc KB", "peak KB");
+	Utils::print_ln(line + string("  frame"));
+	for (auto& [name, total] : rows) {
+		used = snprintf(line, sizeof(line), "  %10llu %12.3f %12.3f", (unsigned long long)total.calls, total.inclusive_ns / 1e6, total.exclusive_ns / 1e6);
+		if (memory) {
+			snprintf(line + used, sizeof(line) - used, " %10llu %12.1f %10.1f", (unsigned long long)total.allocs,
+				total.alloc_bytes / 1024.0, total.peak_bytes / 1024.0);
+		}
+		Utils::print_ln(line + ("  " + name));
+	}
+}
+
+TemplateFileScope::TemplateFileScope(const string& file) : m_active(TemplateProfiler::enabled())
+{
+	if (m_active) {
+		m_previous_file = TemplateProfiler::current_file();
+		m_previous_line = TemplateProfiler::current_line();
+		TemplateProfiler::set_file(file);
+		TemplateProfiler::set_line(1);
+	}
+}
+
+TemplateFileScope::~TemplateFileScope()
+{
+	if (m_active) {
+		TemplateProfiler::set_file(m_previous_file);
+		TemplateProfiler::set_line(m_previous_line);
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <ostream>
+
+/// <summary>
+/// Template level profiler switched on with --template-profile. Records a call
+/// tree of AST statements, taken if branches, includes and function calls with
+/// counts and inclusive / exclusive wall time. Frames are named "file:line statement".
+/// The tree is kept per thread.
+/// </summary>
+class TemplateProfiler
+{
+private:
+	static std::atomic<bool> s_enabled;
+public:
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void set_enabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+	static void enter(const std::string& frame);
+	static void leave();
+	static void reset();
+
+	// Source position used to label statements while they are parsed, and function calls while they run
+	static const std::string& current_file();
+	static void set_file(const std::string& file);
+	static size_t current_line();
+	static void set_line(size_t line);
+	static std::string frame_label(std::string_view statement);
+
+	// Collapsed stacks ("a;b;c <exclusive microseconds>") for flame graph tools
+	static void write_collapsed(std::ostream& out);
+	static void print_summary(size_t max_rows = 20);
+};
+
+/// <summary>
+/// One frame for the lifetime of the scope, no-op when frame is empty. A non-zero line
+/// becomes the current line while the frame is open, so frames entered during its
+/// evaluation (function calls) are attributed to it.
+/// </summary>
+class TemplateFrame
+{
+private:
+	bool m_active;
+	size_t m_previous_line = 0;
+	bool m_sets_line = false;
+public:
+	explicit TemplateFrame(const std::string& frame, size_t line = 0) : m_active(!frame.empty() && TemplateProfiler::enabled())
+	{
+		if (!m_active) return;
+		if (line) {
+			m_sets_line = true;
+			m_previous_line = TemplateProfiler::current_line();
+			TemplateProfiler::set_line(line);
+		}
+		TemplateProfiler::enter(frame);
+	}
+	~TemplateFrame()
+	{
+		if (!m_active) return;
+		TemplateProfiler::leave();
+		if (m_sets_line) TemplateProfiler::set_line(m_previous_line);
+	}
+
+	TemplateFrame(const TemplateFrame&) = delete;
+	TemplateFrame& operator=(const TemplateFrame&) = delete;
+};
+
+/// <summary>
+/// Sets the file statements are attributed to and restores the previous one
+/// </summary>
+class TemplateFileScope
+{
+private:
+	bool m_active;
+	std::string m_previous_file;
+	size_t m_previous_line = 0;
+public:
+	explicit TemplateFileScope(const std::string& file);
+	~TemplateFileScope();
+
+	TemplateFileScope(const TemplateFileScope&) = delete;
+	TemplateFileScope& operator=(const TemplateFileScope&) = delete;
+};
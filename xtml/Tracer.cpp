@@ -0,0 +1,106 @@
+#include "Tracer.h"
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+namespace {
+	struct TraceEvent {
+		const char* category;
+		string name;
+		uint64_t start_us;
+		uint64_t duration_us;
+		unsigned thread;
+	};
+
+	mutex events_mutex;
+	vector<TraceEvent> events;
+	atomic<unsigned> thread_count(0);
+	const auto trace_start = chrono::steady_clock::now();
+
+	unsigned thread_index()
+	{
+		thread_local unsigned index = thread_count++;
+		return index;
+	}
+
+	void write_json_string(ofstream& out, const string& value)
+	{
+		out << '"';
+		for (char c : value) {
+			switch (c) {
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out << escaped;
+				}
+				else {
+					out << c;
+				}
+			}
+		}
+		out << '"';
+	}
+}
+
+void Tracer::set_enabled(bool enabled)
+{
+	thread_index(); // The enabling thread gets track 0
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now_us()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - trace_start).count();
+}
+
+void Tracer::add_span(const char* category, const string& name, uint64_t start_us, uint64_t end_us)
+{
+	unsigned thread = thread_index();
+	lock_guard<mutex> lock(events_mutex);
+	events.push_back(TraceEvent{ category, name, start_us, end_us - start_us, thread });
+}
+
+bool Tracer::write(const string& path)
+{
+	ofstream out(path);
+	if (!out.is_open()) {
+		return false;
+	}
+
+	lock_guard<mutex> lock(events_mutex);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	auto separator = [&]() {
+		out << (first ? "\n" : ",\n");
+		first = false;
+	};
+
+	// Name the thread tracks, the thread that enabled tracing is the main thread
+	unsigned threads = thread_count.load();
+	for (unsigned i = 0; i < threads; ++i) {
+		separator();
+		out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\""
+			<< (i == 0 ? string("main") : "worker " + to_string(i)) << "\"}}";
+	}
+
+	for (auto& event : events) {
+		separator();
+		out << "{\"ph\":\"X\",\"cat\":\"" << event.category << "\",\"name\":";
+		write_json_string(out, event.name);
+		out << ",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us << "}";
+	}
+	out << "\n]}\n";
+	return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// Chrome trace-event recorder switched on with --trace. Spans are collected
+/// in memory and written as JSON that chrome://tracing and Perfetto can open,
+/// with one track per thread.
+/// </summary>
+class Tracer
+{
+private:
+	static std::atomic<bool> s_enabled;
+public:
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void set_enabled(bool enabled);
+
+	static uint64_t now_us();
+	static void add_span(const char* category, const std::string& name, uint64_t start_us, uint64_t end_us);
+	static bool write(const std::string& path);
+};
+
+/// <summary>
+/// Records a span for the lifetime of the scope, no-op when name is empty
+/// </summary>
+class TraceSpan
+{
+private:
+	const char* m_category;
+	std::string m_name;
+	uint64_t m_start = 0;
+public:
+	TraceSpan(const char* category, std::string name) : m_category(category), m_name(std::move(name)) { if (!m_name.empty()) m_start = Tracer::now_us(); }
+	~TraceSpan() { if (!m_name.empty()) Tracer::add_span(m_category, m_name, m_start, Tracer::now_us()); }
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
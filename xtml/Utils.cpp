@@ -1,5 +1,9 @@
 #pragma once
 #include "Utils.h"  
+#include "RenderContext.h"
+#include "Profiler.h"
+#include "Tracer.h"
+#include "Logger.h"
 #include <algorithm>  
 #include <iostream>  
 #include <fstream>
@@ -34,24 +38,43 @@ bool Utils::is_bool(const std::string& s)
 
 void Utils::print_ln(const std::string& str)
 {
-	std::cout << str << std::endl;
+	log(LL_INFO, str);
 }
 
 void Utils::printerr_ln(const std::string& str)
 {
-	std::cerr << str << std::endl;
+	log(LL_ERROR, str);
+}
+
+void Utils::log(LogLevel level, const std::string& str)
+{
+	if (!Logger::enabled(level)) return;
+	if (auto log = RenderContext::current().log) {
+		(*log)(level, str);
+		return;
+	}
+	Logger::write(level, str);
 }
 
 void Utils::throw_err(const std::string& str, const std::string& stack_trace)
 {	
-	const std::string red = "\033[31m";
-	const std::string reset = "\033[0m";
+	if (auto log = RenderContext::current().log) {
+		(*log)(LL_ERROR, "Error: " + str);
+		if (!stack_trace.empty()) {
+			(*log)(LL_ERROR, "Stack trace:\n" + stack_trace);
+		}
+		throw std::runtime_error(str);
+	}
 
-	std::cerr << red << "Error: " << str << reset << std::endl;
+	// Color codes would end up inside the message text of JSON lines
+	const std::string red = Logger::json() ? "" : "\033[31m";
+	const std::string reset = Logger::json() ? "" : "\033[0m";
+
+	Logger::write(LL_ERROR, red + "Error: " + str + reset);
 
 	if (!stack_trace.empty()) {
-		std::cerr << red << "Stack trace:" << reset << std::endl;
-		std::cerr << stack_trace << std::endl;
+		Logger::write(LL_ERROR, red + "Stack trace:" + reset);
+		Logger::write(LL_ERROR, stack_trace);
 	}
 
 	throw std::runtime_error(str);
@@ -67,32 +90,37 @@ std::string Utils::escape_str(const std::string& str)
 	return result;
 }
 
-std::string Utils::file_name(const std::string& file_path)
+std::string Utils::file_name(std::string_view file_path)
 {
 	size_t last_slash = file_path.find_last_of("/\\");
-	if (last_slash == std::string::npos) return file_path;
-	return file_path.substr(last_slash + 1);
+	if (last_slash == std::string_view::npos) return std::string(file_path);
+	return std::string(file_path.substr(last_slash + 1));
 }
 
-std::string Utils::file_name_no_ext(const std::string& file_name)
+std::string Utils::file_name_no_ext(std::string_view file_name)
 {
 	size_t last_dot = file_name.find_last_of('.');
-	if (last_dot == std::string::npos) return file_name;
-	return file_name.substr(0, last_dot);
+	if (last_dot == std::string_view::npos) return std::string(file_name);
+	return std::string(file_name.substr(0, last_dot));
 }
 
-std::string Utils::file_path_parent(const std::string& file_path)
+std::string Utils::file_path_parent(std::string_view file_path)
 {
 	size_t last_slash = file_path.find_last_of("/\\");
-	if (last_slash != std::string::npos)
-		return file_path.substr(0, last_slash);
+	if (last_slash != std::string_view::npos)
+		return std::string(file_path.substr(0, last_slash));
 	return "";
 }
 
-std::string Utils::trim(const std::string& str)
+std::string Utils::trim(std::string_view str)
+{
+	return std::string(trim_view(str));
+}
+
+std::string_view Utils::trim_view(std::string_view str)
 {
 	size_t first = str.find_first_not_of(" \t\n\r");
-	if (first == std::string::npos) return "";
+	if (first == std::string_view::npos) return std::string_view();
 	size_t last = str.find_last_not_of(" \t\n\r");
 	return str.substr(first, (last - first + 1));
 }
@@ -107,13 +135,33 @@ std::string Utils::trim_quotes(const std::string& str)
 
 std::string Utils::read_file(const std::string& filename)
 {
-	std::ifstream file(filename); // Ensure std::ifstream is included  
+	ProfileScope profile(PS_READ_FILE);
+	TraceSpan trace("io", Tracer::enabled() ? "read " + filename : std::string());
+	// Templates need an owned string (build_content rewrites the page block by block), so
+	// they are read straight into one. Mapping them would only add a copy, and keeping a
+	// mapping alive in the daemon's cached templates faults (SIGBUS) once the file is
+	// truncated. Read-only consumers such as Json::load_file scan a MappedFile view instead.
+	std::ifstream file(filename);
 	if (!file.is_open()) {
 		throw std::runtime_error("Could not open file: " + filename);
 	}
-	std::stringstream buffer;
-	buffer << file.rdbuf();
-	return buffer.str();
+	file.seekg(0, std::ios::end);
+	auto size = file.tellg();
+	std::string content;
+	if (size < 0) {
+		// Not seekable (a pipe), read it to the end
+		file.clear();
+		content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return content;
+	}
+	file.seekg(0, std::ios::beg);
+	if (size > 0) {
+		content.resize(static_cast<size_t>(size));
+		file.read(content.data(), size);
+		// Text mode reads fewer characters than the file size where line ends are translated
+		content.resize(static_cast<size_t>(file.gcount()));
+	}
+	return content;
 }
 
 std::string Utils::replace_whitespace(const std::string& str, char replacement)
@@ -169,13 +217,54 @@ bool Utils::is_path_absolute(const std::string& path)
 	if (path.size() >= 2 && std::isalpha(path[0]) && path[1] == ':') {
 		return true; // Windows absolute path (e.g., C:\)
 	}
+#ifndef _WIN32
+	if (!path.empty() && path[0] == '/') {
+		return true; // POSIX absolute path
+	}
+#endif
 	return false;
 }
 
+std::string Utils::join_path(const std::string& base, const std::string& name)
+{
+	if (base.empty()) return name;
+#ifdef _WIN32
+	return base + "\\" + name;
+#else
+	return base + "/" + name;
+#endif
+}
+
+std::string Utils::url_decode(std::string_view str)
+{
+	auto hex = [](char c) -> int {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	};
+
+	std::string result;
+	result.reserve(str.size());
+	for (size_t i = 0; i < str.size(); ++i) {
+		if (str[i] == '+') {
+			result += ' ';
+		}
+		else if (str[i] == '%' && i + 2 < str.size() && hex(str[i + 1]) >= 0 && hex(str[i + 2]) >= 0) {
+			result += static_cast<char>(hex(str[i + 1]) * 16 + hex(str[i + 2]));
+			i += 2;
+		}
+		else {
+			result += str[i];
+		}
+	}
+	return result;
+}
+
 std::string Utils::generate_uuid()
 {
 	int seed = std::chrono::steady_clock::now().time_since_epoch().count();
-	static std::mt19937 rng(seed);
+	thread_local std::mt19937 rng(seed);
 	std::uniform_int_distribution<int> dist(0, 61);
 
 	const char charset[] =
@@ -1,6 +1,8 @@
 #pragma once  
 #include <string>  
 #include <vector>  
+#include <string_view>
+#include "Logger.h"
 
 class Utils  
 {  
@@ -11,12 +13,15 @@ static bool is_string(const std::string& s);
 static bool is_bool(const std::string& s);
 static void print_ln(const std::string& str);  
 static void printerr_ln(const std::string& str);  
+// Leveled message, dropped when the level is disabled
+static void log(LogLevel level, const std::string& str);
 static void throw_err(const std::string& str, const std::string& stack_trace = "");
 static std::string escape_str(const std::string& str);
-static std::string file_name(const std::string& file_path);  
-static std::string file_name_no_ext(const std::string& file_name);  
-static std::string file_path_parent(const std::string& file_path);
-static std::string trim(const std::string& str);  
+static std::string file_name(std::string_view file_path);  
+static std::string file_name_no_ext(std::string_view file_name);  
+static std::string file_path_parent(std::string_view file_path);
+static std::string trim(std::string_view str);  
+static std::string_view trim_view(std::string_view str);
 static std::string trim_quotes(const std::string& str);  
 static std::string read_file(const std::string& filename);  
 static std::string replace_whitespace(const std::string& str, char replacement);  
@@ -25,6 +30,8 @@ static std::string replace(const std::string& str, const std::string& from, cons
 static bool starts_with(const std::string& str, const std::string& prefix);
 static bool ends_with(const std::string& str, const std::string& suffix);
 static bool is_path_absolute(const std::string& path);
+static std::string join_path(const std::string& base, const std::string& name);
+static std::string url_decode(std::string_view str); // Decode %XX escapes and '+' as space
 static std::string generate_uuid();
 
 
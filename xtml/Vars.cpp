@@ -7,10 +7,155 @@
 #include <cctype>
 #include <vector>
 #include <iterator>
-#include "Globals.h"
+#include <cstring>
+#include "FunctionRegistry.h"
+#include "RenderContext.h"
 
 using namespace std;
 
+enum ArrayLayout
+{
+	AL_EMPTY,
+	AL_NUMBERS, // Contiguous int64 column
+	AL_STRINGS, // Offsets into one character blob
+	AL_BOXED // Mixed element types, one var per element
+};
+
+struct VarArray::Storage {
+	ArrayLayout layout = AL_EMPTY;
+	size_t capacity = 0;
+	vector<int64_t> numbers;
+	vector<size_t> offsets; // offsets[i]..offsets[i + 1] is string i
+	string blob;
+	vector<var> boxed;
+
+	size_t size() const {
+		switch (layout) {
+		case AL_NUMBERS: return numbers.size();
+		case AL_STRINGS: return offsets.size() - 1;
+		case AL_BOXED: return boxed.size();
+		default: return 0;
+		}
+	}
+};
+
+// Only numbers which print back to the same text can live in the int64 column
+static bool is_columnar_number(const var& item, int64_t& out)
+{
+	if (item.type != DT_NUMBER || !Utils::is_number(item.value) || item.value.size() > 18) return false;
+	if (item.value.size() > 1 && item.value[0] == '0') return false;
+	out = stoll(item.value);
+	return true;
+}
+
+size_t VarArray::size() const
+{
+	return m_storage ? m_storage->size() : 0;
+}
+
+var VarArray::at(size_t index) const
+{
+	var item;
+	load(index, item);
+	return item;
+}
+
+void VarArray::load(size_t index, var& out) const
+{
+	if (index >= size()) {
+		Utils::throw_err("Error: Array index out of bounds: " + to_string(index));
+	}
+	if (m_storage->layout == AL_BOXED) {
+		out = m_storage->boxed[index];
+		return;
+	}
+
+	// Box the column entry, reusing the buffer of the target value
+	if (m_storage->layout == AL_NUMBERS) {
+		out.value = to_string(m_storage->numbers[index]);
+		out.type = DT_NUMBER;
+	}
+	else {
+		out.value.assign(m_storage->blob, m_storage->offsets[index], m_storage->offsets[index + 1] - m_storage->offsets[index]);
+		out.type = DT_STRING;
+	}
+	out.array = VarArray();
+	out.iterable.reset();
+	out.object.reset();
+}
+
+VarArray::Storage& VarArray::mutable_storage()
+{
+	// Copy the buffer before writing if any other value still refers to it
+	if (!m_storage) {
+		m_storage = make_shared<Storage>();
+	}
+	else if (m_storage.use_count() > 1) {
+		m_storage = make_shared<Storage>(*m_storage);
+	}
+	return *m_storage;
+}
+
+void VarArray::push_back(var item)
+{
+	auto& storage = mutable_storage();
+	int64_t number = 0;
+
+	// The first element picks the layout
+	if (storage.layout == AL_EMPTY) {
+		if (is_columnar_number(item, number)) {
+			storage.layout = AL_NUMBERS;
+			storage.numbers.reserve(storage.capacity);
+		}
+		else if (item.type == DT_STRING) {
+			storage.layout = AL_STRINGS;
+			storage.offsets.reserve(storage.capacity + 1);
+			storage.offsets.push_back(0);
+		}
+		else {
+			storage.layout = AL_BOXED;
+			storage.boxed.reserve(storage.capacity);
+		}
+	}
+
+	if (storage.layout == AL_NUMBERS && is_columnar_number(item, number)) {
+		storage.numbers.push_back(number);
+		return;
+	}
+	if (storage.layout == AL_STRINGS && item.type == DT_STRING) {
+		storage.blob += item.value;
+		storage.offsets.push_back(storage.blob.size());
+		return;
+	}
+
+	// Mixed element types, fall back to one var per element
+	if (storage.layout != AL_BOXED) {
+		vector<var> boxed;
+		boxed.reserve(max(storage.capacity, storage.size() + 1));
+		for (size_t i = 0; i < storage.size(); ++i) {
+			boxed.push_back(at(i));
+		}
+		storage.numbers = vector<int64_t>();
+		storage.offsets = vector<size_t>();
+		storage.blob = string();
+		storage.boxed = move(boxed);
+		storage.layout = AL_BOXED;
+	}
+	storage.boxed.push_back(move(item));
+}
+
+void VarArray::reserve(size_t capacity)
+{
+	auto& storage = mutable_storage();
+	storage.capacity = capacity;
+	switch (storage.layout) {
+	case AL_NUMBERS: storage.numbers.reserve(capacity); break;
+	case AL_STRINGS: storage.offsets.reserve(capacity + 1); break;
+	case AL_BOXED: storage.boxed.reserve(capacity); break;
+	default: break;
+	}
+}
+
 string Vars::trim_var(const string& var)
 {
 	string trimmed = var;
@@ -27,8 +172,9 @@ tuple<string, string> Vars::parse_var(const std::string& line)
 {
 	size_t eq_pos = line.find('=');
 	if (eq_pos != std::string::npos) {
-		std::string key = Utils::trim(line.substr(0, eq_pos));
-		std::string value = Utils::trim(line.substr(eq_pos + 1));
+		std::string_view view = line;
+		std::string key = Utils::trim(view.substr(0, eq_pos));
+		std::string value = Utils::trim(view.substr(eq_pos + 1));
 		return make_tuple(key, value);
 	}
 	return make_tuple("", "");
@@ -67,7 +213,7 @@ vector<string> Vars::parse_tokens(const string& expr, const char ops[], bool add
 	return tokens;
 }
 
-string Vars::replace_vars(string& content, const map<string, var>& vars)
+string Vars::replace_vars(string& content, const VarMap& vars)
 {
 	for (const auto& var : vars) {
 		const string& key = var.first;
@@ -121,13 +267,13 @@ string Vars::preprocess_content(const string& content)
 	return result;
 }
 
-bool Vars::is_string_expr(const string& expr, const map<string, var>& vars)
+bool Vars::is_string_expr(const string& expr, const VarMap& vars)
 {
 	auto tokens = parse_tokens(expr, "+", false);
 	return is_string_expr(tokens, vars);
 }
 
-bool Vars::is_string_expr(vector<string>& tokens, const map<string, var>& vars)
+bool Vars::is_string_expr(vector<string>& tokens, const VarMap& vars)
 {
 	for (auto& token : tokens) {
 		token = Utils::trim(token);
@@ -152,7 +298,7 @@ bool Vars::is_string_expr(vector<string>& tokens, const map<string, var>& vars)
 	return true;
 }
 
-bool Vars::is_numeric_expr(vector<string>& tokens, const map<string, var>& vars)
+bool Vars::is_numeric_expr(vector<string>& tokens, const VarMap& vars)
 {
 	for (auto& token : tokens) {
 		token = Utils::trim(token);
@@ -177,7 +323,7 @@ bool Vars::is_numeric_expr(vector<string>& tokens, const map<string, var>& vars)
 	return true;
 }
 
-bool Vars::is_bool_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars)
+bool Vars::is_bool_expr(std::vector<std::string>& tokens, const VarMap& vars)
 {
 	for (auto& token : tokens) {
 		token = Utils::trim(token);
@@ -252,7 +398,31 @@ vector<string> Vars::parse_top_level_tokens(const string& expr)
 	return tokens;
 }
 
-var Vars::eval_expr(const string& expr, const map<string, var>& vars)
+// Applies the only operator of expressions, '+': concatenation if either side is a string, addition of numbers
+static void add_operand(var& result, var operand, const string& expr)
+{
+	if (result.type == DT_UNKNOWN) {
+		result = move(operand);
+	}
+	else {
+		if (result.type == DT_STRING || operand.type == DT_STRING) {
+			// String concatenation
+			result.value += operand.value;
+			result.type = DT_STRING;
+		}
+		else if (result.type == DT_NUMBER && operand.type == DT_NUMBER) {
+			// Numeric addition
+			int64_t sum = std::stoll(result.value) + std::stoll(operand.value);
+			result.value = std::to_string(sum);
+			result.type = DT_NUMBER;
+		}
+		else {
+			Utils::throw_err("Error: Incompatible types in expression: " + expr);
+		}
+	}
+}
+
+var Vars::eval_expr(const string& expr, const VarMap& vars)
 {
 	auto outval = string();
 	auto tokens = parse_top_level_tokens(expr);
@@ -263,57 +433,153 @@ var Vars::eval_expr(const string& expr, const map<string, var>& vars)
 		if (token.empty()) continue;
 
 		// Step 1: Evaluate the token to a var
-		var evaledToken = { "", DT_UNKNOWN };
-		if (is_function_expr(token)) {
-			evaledToken = eval_func_expr(token, vars);
-		}
-		else if (is_array_expr(token)) {
-			evaledToken = eval_array_expr(token, vars);
-		}
-		else if (Utils::is_string(token)) {
-			auto str = Utils::trim_quotes(token);
-			str = Utils::escape_str(str);
-			evaledToken = { str, DT_STRING };
-		}
-		else if (Utils::is_number(token)) {
-			evaledToken = { token, DT_NUMBER };
-		}
-		else if (Utils::is_bool(token)) {
-			evaledToken = { (token == "true" || token == "1") ? "1" : "0", DT_BOOL };
-		}
-		else if (vars.find(token) != vars.end()) {
-			evaledToken = vars.at(token);
-		}
-		else {
-			Utils::throw_err("Error: Unknown token in expression: " + token, "");
-		}
+		var evaledToken = eval_token(token, vars);
 
 		// Step 2: Determine how to handle the evaluated token (for this case it's only + operator)
-		if (result.type == DT_UNKNOWN) {
-			result = evaledToken;
-		}
-		else {
-			if (result.type == DT_STRING || evaledToken.type == DT_STRING) {
-				// String concatenation
-				result.value += evaledToken.value;
-				result.type = DT_STRING;
-			}
-			else if (result.type == DT_NUMBER && evaledToken.type == DT_NUMBER) {
-				// Numeric addition
-				int64_t sum = std::stoll(result.value) + std::stoll(evaledToken.value);
-				result.value = std::to_string(sum);
-				result.type = DT_NUMBER;
-			}
-			else {
-				Utils::throw_err("Error: Incompatible types in expression: " + expr);
-			}
-		}
+		add_operand(result, move(evaledToken), expr);
 	}
 	//Utils::print_ln("Evaluated expression: " + expr + " => " + result.value + " (type: " + (result.type == DT_STRING ? "string" : result.type == DT_NUMBER ? "number" : "unknown") + ")");
 	return result;
 }
 
-var Vars::eval_str_expr(vector<string>& tokens, const map<string, var>& vars)
+/// <summary>
+/// Split an expression into operands once, resolving the function calls among them
+/// </summary>
+/// <param name="expr"></param>
+/// <returns></returns>
+CompiledExpr Vars::compile_expr(const string& expr)
+{
+	CompiledExpr compiled;
+	compiled.text = expr;
+	for (auto& token : parse_top_level_tokens(expr)) {
+		auto trimmed = Utils::trim(token);
+		if (trimmed.empty()) continue;
+		compiled.operands.push_back(compile_operand(trimmed));
+	}
+	return compiled;
+}
+
+CompiledExpr::Operand Vars::compile_operand(const string& token)
+{
+	CompiledExpr::Operand operand;
+	operand.token = token;
+	if (!is_function_expr(token)) {
+		return operand;
+	}
+
+	// Calls ParseFunctionCall would reject stay tokens, so the error is raised when they are evaluated
+	auto expr = Utils::trim(token);
+	std::string_view rest = expr;
+	rest = Utils::trim_view(rest.substr(rest.find("::") + 2));
+	if (rest.find('(') == std::string_view::npos || rest.back() != ')') {
+		return operand;
+	}
+
+	auto [namespaceName, functionName, args] = FunctionRegistry::ParseFunctionCall(expr);
+	auto call = make_shared<FunctionCall>();
+	call->namespaceId = Symbols::intern(namespaceName);
+	call->functionId = Symbols::intern(functionName);
+	call->namespaceName = move(namespaceName);
+	call->functionName = move(functionName);
+	call->args.reserve(args.size());
+	for (auto& arg : args) {
+		call->args.push_back(compile_expr(arg));
+	}
+	operand.call = move(call);
+	return operand;
+}
+
+var Vars::eval_expr(const CompiledExpr& expr, const VarMap& vars)
+{
+	var result = { "", DT_UNKNOWN };
+	for (auto& operand : expr.operands) {
+		add_operand(result, eval_operand(operand, vars), expr.text);
+	}
+	return result;
+}
+
+var Vars::eval_operand(const CompiledExpr::Operand& operand, const VarMap& vars)
+{
+	return operand.call ? eval_call(*operand.call, vars) : eval_token(operand.token, vars);
+}
+
+var Vars::eval_call(const FunctionCall& call, const VarMap& vars)
+{
+	vector<var> funcArgs;
+	funcArgs.reserve(call.args.size());
+	for (auto& arg : call.args) {
+		auto evaledArg = eval_expr(arg, vars);
+		if (evaledArg.type == DT_UNKNOWN) {
+			Utils::throw_err("Error: Failed to evaluate function argument: " + arg.text);
+		}
+		funcArgs.push_back(move(evaledArg));
+	}
+
+	// No parsing, interning or string hashing left: the ids index the frozen function table
+	FunctionRegistry::ReadScope functions;
+	if (auto func = RenderContext::function_registry().FindFunction(call.namespaceId, call.functionId)) {
+		return FunctionRegistry::Invoke(*func, call.namespaceName, call.functionName, funcArgs);
+	}
+	Utils::throw_err("Error: Function not found: " + call.namespaceName + "::" + call.functionName);
+	return var();
+}
+
+var Vars::eval_token(const string& token, const VarMap& vars)
+{
+	// Evaluate a single operand of an expression (no top level operators)
+	if (is_function_expr(token)) {
+		return eval_func_expr(token, vars);
+	}
+	else if (is_array_expr(token)) {
+		return eval_array_expr(token, vars);
+	}
+	else if (Utils::is_string(token)) {
+		auto str = Utils::trim_quotes(token);
+		str = Utils::escape_str(str);
+		return { str, DT_STRING };
+	}
+	else if (Utils::is_number(token)) {
+		return { token, DT_NUMBER };
+	}
+	else if (Utils::is_bool(token)) {
+		return { (token == "true" || token == "1") ? "1" : "0", DT_BOOL };
+	}
+	else if (auto it = vars.find(token); it != vars.end()) {
+		return it->second;
+	}
+	else if (auto member = find_member(token, vars)) {
+		return *member;
+	}
+	Utils::throw_err("Error: Unknown token in expression: " + token, "");
+	return { "", DT_UNKNOWN };
+}
+
+const var* Vars::find_member(string_view path, const VarMap& vars)
+{
+	// Resolve a dotted field path like post.author.name through DT_OBJECT values
+	size_t dot = path.find('.');
+	if (dot == string_view::npos) return nullptr;
+
+	auto it = vars.find(path.substr(0, dot));
+	if (it == vars.end()) return nullptr;
+	const var* current = &it->second;
+	while (dot != string_view::npos) {
+		if (current->type != DT_OBJECT || !current->object) return nullptr;
+		size_t next = path.find('.', dot + 1);
+		current = current->object->field(path.substr(dot + 1, next == string_view::npos ? string_view::npos : next - dot - 1));
+		if (!current) return nullptr;
+		dot = next;
+	}
+	return current;
+}
+
+const var* VarObject::field(string_view name) const
+{
+	auto it = fields.find(name);
+	return it == fields.end() ? nullptr : &it->second;
+}
+
+var Vars::eval_str_expr(vector<string>& tokens, const VarMap& vars)
 {
 	auto outval = string();
 	for (auto& token : tokens) {
@@ -335,7 +601,7 @@ var Vars::eval_str_expr(vector<string>& tokens, const map<string, var>& vars)
 	return var{ outval, DT_STRING };
 }
 
-var Vars::eval_num_expr(vector<string>& tokens, const map<string, var>& vars)
+var Vars::eval_num_expr(vector<string>& tokens, const VarMap& vars)
 {
 	// @var total = 5 + 10;
 	// @var total = 5 + 10 + var1 + var2;
@@ -364,7 +630,7 @@ var Vars::eval_num_expr(vector<string>& tokens, const map<string, var>& vars)
 	return { std::to_string(sum), DT_NUMBER };
 }
 
-var Vars::eval_func_expr(vector<string>& tokens, const map<string, var>& vars)
+var Vars::eval_func_expr(vector<string>& tokens, const VarMap& vars)
 {
 	// e.g. std::toUpper("hello")
 	if (tokens.size() != 1) {
@@ -375,26 +641,28 @@ var Vars::eval_func_expr(vector<string>& tokens, const map<string, var>& vars)
 
 	// Prepare funct args
 	vector<var> funcArgs;
+	funcArgs.reserve(args.size());
 	for (auto& arg : args) {
 		auto evaledArg = eval_expr(arg, vars);
 		if (evaledArg.type == DT_UNKNOWN) {
 			Utils::throw_err("Error: Failed to evaluate function argument: " + arg);
 		}
-		funcArgs.push_back(evaledArg);
+		funcArgs.push_back(move(evaledArg));
 	}
 
 	// Call function
-	if (g_functionRegistry.Exists(namespaceName, functionName)) {
-		return g_functionRegistry.CallFunction(namespaceName, functionName, funcArgs);
+	FunctionRegistry::ReadScope functions;
+	if (auto func = RenderContext::function_registry().FindFunction(namespaceName, functionName)) {
+		return FunctionRegistry::Invoke(*func, namespaceName, functionName, funcArgs);
 	}
 	else {
 		Utils::throw_err("Error: Function not found: " + namespaceName + "::" + functionName);
 	}
 }
 
-map<string, var> Vars::merge_vars(const map<string, var>& arr1, const map<string, var>& arr2)
+VarMap Vars::merge_vars(const VarMap& arr1, const VarMap& arr2)
 {
-	map<string, var> result = arr1;
+	VarMap result = arr1;
 
 	for (auto& [key, value] : arr2) {
 		result[key] = value;
@@ -411,24 +679,26 @@ bool Vars::is_function_expr(const string& token)
 	return false;
 }
 
-var Vars::eval_func_expr(const string& token, const map<string, var>& vars)
+var Vars::eval_func_expr(const string& token, const VarMap& vars)
 {
 	auto expr = Utils::trim(token);
 	auto [namespaceName, functionName, args] = FunctionRegistry::ParseFunctionCall(expr);
 
 	// Prepare funct args
 	vector<var> funcArgs;
+	funcArgs.reserve(args.size());
 	for (auto& arg : args) {
 		auto evaledArg = eval_expr(arg, vars);
 		if (evaledArg.type == DT_UNKNOWN) {
 			Utils::throw_err("Error: Failed to evaluate function argument: " + arg);
 		}
-		funcArgs.push_back(evaledArg);
+		funcArgs.push_back(move(evaledArg));
 	}
 
 	// Call function
-	if (g_functionRegistry.Exists(namespaceName, functionName)) {
-		return g_functionRegistry.CallFunction(namespaceName, functionName, funcArgs);
+	FunctionRegistry::ReadScope functions;
+	if (auto func = RenderContext::function_registry().FindFunction(namespaceName, functionName)) {
+		return FunctionRegistry::Invoke(*func, namespaceName, functionName, funcArgs);
 	}
 	else {
 		Utils::throw_err("Error: Function not found: " + namespaceName + "::" + functionName);
@@ -443,7 +713,7 @@ bool Vars::is_array_expr(const std::string& token)
 	return false;
 }
 
-var Vars::eval_array_expr(const std::string& token, const std::map<std::string, var>& vars)
+var Vars::eval_array_expr(const std::string& token, const VarMap& vars)
 {
 	// e.g. [ "item1", "item2", var1, var2 ]
 
@@ -484,12 +754,13 @@ var Vars::eval_array_expr(const std::string& token, const std::map<std::string,
 
 	var result;
 	result.type = DT_ARRAY;
+	result.array.reserve(tokens.size());
 	for (auto& item : tokens) {
 		auto evaledItem = eval_expr(item, vars);
 		if (evaledItem.type == DT_UNKNOWN) {
 			Utils::throw_err("Error: Failed to evaluate array item: " + item);
 		}
-		result.array.push_back(evaledItem);
+		result.array.push_back(move(evaledItem));
 	}
 	return result;
 }
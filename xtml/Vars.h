@@ -2,6 +2,35 @@
 #include <string>  
 #include <map>  
 #include <vector>  
+#include <memory>
+#include <string_view>
+
+class VarIterable;
+class VarObject;
+struct var;
+struct FunctionCall;
+
+/// <summary>
+/// Reference counted array storage for DT_ARRAY values. Copies share one
+/// immutable buffer, mutations copy it first if it is shared (copy-on-write).
+/// Homogeneous arrays of numbers or strings are stored in columns and only
+/// boxed into var values when an element is accessed.
+/// </summary>
+class VarArray
+{
+private:
+	struct Storage;
+	std::shared_ptr<Storage> m_storage;
+
+	Storage& mutable_storage();
+public:
+	size_t size() const;
+	bool empty() const { return size() == 0; }
+	var at(size_t index) const;
+	void load(size_t index, var& out) const;
+	void push_back(var item);
+	void reserve(size_t capacity);
+};
 
 enum DataType
 {
@@ -9,13 +38,47 @@ enum DataType
 	DT_NUMBER,
 	DT_BOOL,
 	DT_ARRAY,
+	DT_ITERABLE,
+	DT_OBJECT,
 	DT_UNKNOWN
 };
 
 struct var {
 	std::string value;
 	DataType type;
-	std::vector<var> array; // For DT_ARRAY type
+	VarArray array; // For DT_ARRAY type
+	std::shared_ptr<VarIterable> iterable; // For DT_ITERABLE type
+	std::shared_ptr<const VarObject> object; // For DT_OBJECT type
+};
+
+// Variable scope. The transparent comparator allows lookups by std::string_view without temporaries.
+using VarMap = std::map<std::string, var, std::less<>>;
+
+/// <summary>
+/// Named fields of a DT_OBJECT value, accessed as name.field in expressions.
+/// Subclasses may decode fields on first access instead of filling fields.
+/// </summary>
+class VarObject
+{
+public:
+	VarMap fields;
+
+	virtual ~VarObject() = default;
+	virtual const var* field(std::string_view name) const;
+	virtual size_t size() const { return fields.size(); }
+};
+
+/// <summary>
+/// An expression split into its top level operands when its AST node is built, with function
+/// calls resolved to namespace and function ids. Evaluates like Vars::eval_expr on its text.
+/// </summary>
+struct CompiledExpr {
+	struct Operand {
+		std::string token;
+		std::shared_ptr<const FunctionCall> call; // Set when the token is a function call
+	};
+	std::string text;
+	std::vector<Operand> operands;
 };
 
 class Vars  
@@ -24,24 +87,31 @@ public:
 	static std::string trim_var(const std::string& var);  
 	static std::tuple<std::string, std::string> parse_var(const std::string& line);
 	static std::vector<std::string> parse_tokens(const std::string& expr, const char* ops, bool addop);  
-	static std::string replace_vars(std::string& content, const std::map<std::string, var>& vars);
+	static std::string replace_vars(std::string& content, const VarMap& vars);
 	static std::string preprocess_content(const std::string& content);
-	static bool is_string_expr(const std::string& expr, const std::map<std::string, var>& vars);
-	static bool is_string_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
-	static bool is_numeric_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
-	static bool is_bool_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
+	static bool is_string_expr(const std::string& expr, const VarMap& vars);
+	static bool is_string_expr(std::vector<std::string>& tokens, const VarMap& vars);
+	static bool is_numeric_expr(std::vector<std::string>& tokens, const VarMap& vars);
+	static bool is_bool_expr(std::vector<std::string>& tokens, const VarMap& vars);
 	static bool is_function_expr(std::vector<std::string>& tokens);
 	static std::vector<std::string> parse_top_level_tokens(const std::string& expr);
-	static var eval_expr(const std::string& expr, const std::map<std::string, var>& vars);
-	static var eval_str_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
-	static var eval_num_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
-	static var eval_func_expr(std::vector<std::string>& tokens, const std::map<std::string, var>& vars);
-	static std::map<std::string, var> merge_vars(const std::map<std::string, var>& arr1, const std::map<std::string, var>& arr2);
+	static var eval_expr(const std::string& expr, const VarMap& vars);
+	static var eval_token(const std::string& token, const VarMap& vars);
+	static const var* find_member(std::string_view path, const VarMap& vars);
+	static var eval_str_expr(std::vector<std::string>& tokens, const VarMap& vars);
+	static var eval_num_expr(std::vector<std::string>& tokens, const VarMap& vars);
+	static var eval_func_expr(std::vector<std::string>& tokens, const VarMap& vars);
+	static VarMap merge_vars(const VarMap& arr1, const VarMap& arr2);
 
 	static bool is_function_expr(const std::string& token);
-	static var eval_func_expr(const std::string& token, const std::map<std::string, var>& vars);
+	static var eval_func_expr(const std::string& token, const VarMap& vars);
+	static CompiledExpr compile_expr(const std::string& expr);
+	static CompiledExpr::Operand compile_operand(const std::string& token);
+	static var eval_expr(const CompiledExpr& expr, const VarMap& vars);
+	static var eval_operand(const CompiledExpr::Operand& operand, const VarMap& vars);
+	static var eval_call(const FunctionCall& call, const VarMap& vars);
 	static bool is_array_expr(const std::string& token);
-	static var eval_array_expr(const std::string& token, const std::map<std::string, var>& vars);
+	static var eval_array_expr(const std::string& token, const VarMap& vars);
 
 
 };
@@ -14,10 +14,21 @@
 #include "Core.h"
 #include "FunctionRegistry.h"
 #include "ModuleStd.h"
-#include "Module.h"
+#include "ModuleLoader.h"
+#include "Daemon.h"
+#include "Engine.h"
+#include "Json.h"
+#include "Profiler.h"
+#include "TemplateProfiler.h"
+#include "Tracer.h"
+#include "Logger.h"
+#include "Shadow.h"
+#include "AllocProfiler.h"
+#include "Budget.h"
 #include <filesystem>
+#ifdef _WIN32
 #include <Windows.h>
-#include <filesystem>
+#endif
 
 #define VERSION "0.0.0.1"
 
@@ -25,45 +36,59 @@ namespace fs = std::filesystem;
 
 FunctionRegistry g_functionRegistry;
 
-typedef Module* (*CreateModuleFunc)();
-
-void loadModulesFromFolder(const std::string& folderPath) {
-	for (const auto& entry : fs::directory_iterator(folderPath)) {
-		if (entry.path().extension() == ".dll") {
-			std::string dllPath = entry.path().string();
-			HMODULE hModule = LoadLibraryA(dllPath.c_str());
-			if (!hModule) {
-				std::cerr << "Fehler: konnte " << dllPath << " nicht laden." << std::endl;
-				continue;
-			}
-
-			auto createModule = (CreateModuleFunc)GetProcAddress(hModule, "CreateModule");
-			if (!createModule) {
-				std::cerr << "Fehler: CreateModule nicht gefunden in " << dllPath << std::endl;
-				FreeLibrary(hModule);
-				continue;
-			}
-
-			Module* plugin = createModule();
-			plugin->RegisterFunctions(g_functionRegistry);
-		}
-	}
-}
-
 std::string getExeDir() {
+#ifdef _WIN32
 	char buffer[MAX_PATH];
 	GetModuleFileNameA(NULL, buffer, MAX_PATH);
 	fs::path exePath(buffer);
 	return exePath.parent_path().string();
+#else
+	std::error_code ec;
+	auto exePath = fs::read_symlink("/proc/self/exe", ec);
+	return ec ? fs::current_path().string() : exePath.parent_path().string();
+#endif
+}
+
+void register_functions(FunctionRegistry& registry) {
+	auto exe_path = getExeDir();
+	auto modules_path = Utils::join_path(exe_path, "modules");
+	if (!fs::exists(modules_path)) {
+		fs::create_directory(modules_path);
+	}
+	ModuleLoader::register_folder(modules_path, registry);
+
+	// Register standard functions
+	ModuleStd stdModule;
+	stdModule.RegisterFunctions(registry);
 }
 
-void action_build(const std::string& file_path) {
+void init_registry(FunctionRegistry& registry = g_functionRegistry) {
+	register_functions(registry);
+	registry.Freeze();
+}
+
+std::string resolve_input_path(const std::string& file_path) {
+	if (Utils::is_path_absolute(file_path) == false) {
+		return Utils::join_path(fs::current_path().string(), file_path);
+	}
+	return file_path;
+}
 
-	std::string path = file_path;
-	if (Utils::is_path_absolute(path) == false) {
-		auto current_path = fs::current_path().string();
-		path = current_path + "\\" + file_path;
+/// <summary>
+/// Load a --data argument of the form name=file into vars
+/// </summary>
+void load_data_arg(const std::string& arg, VarMap& vars) {
+	auto eq = arg.find('=');
+	if (eq == std::string::npos || eq == 0) {
+		Utils::throw_err("Error: Expected --data <name>=<file>, got: " + arg);
 	}
+	vars[arg.substr(0, eq)] = Core::load_data(resolve_input_path(arg.substr(eq + 1)));
+}
+
+/// <summary>
+/// The page a template builds to: the same name with an .html extension, next to it
+/// </summary>
+std::string output_path_for(const std::string& path) {
 
 	// Get the raw file name
 	auto file_name = Utils::file_name(path);
@@ -71,27 +96,334 @@ void action_build(const std::string& file_path) {
 
 	// Get the file directory
 	auto file_dir = Utils::file_path_parent(path);
-	auto output_path = file_dir + "\\" + file_name;
+	return Utils::join_path(file_dir, file_name);
+}
+
+std::string action_build(const std::string& path, VarMap vars = VarMap()) {
+	auto output_path = output_path_for(path);
 
 	// Build the file and write to output
-	std::map<std::string, var> vars;
 	auto content = Core::build_file(path, vars);
 	Core::write_file(content, output_path);
+	return output_path;
+}
+
+bool write_trace(const std::string& path) {
+	if (!Tracer::write(path)) {
+		Utils::printerr_ln("Error: Could not create file: " + path);
+		return false;
+	}
+	Utils::print_ln("Trace written to " + path);
+	return true;
+}
+
+/// <summary>
+/// Parse one line of a batch variable file: a JSON object (JSON Lines) or name=value pairs separated by '&', URL encoded
+/// </summary>
+VarMap parse_var_set(const std::string& line) {
+	VarMap vars;
+	if (Utils::trim_view(line)[0] == '{') {
+		auto object = Json::parse(line);
+		return object.object->fields;
+	}
+	for (auto& pair : Utils::split(line, '&')) {
+		if (pair.empty()) {
+			continue;
+		}
+		auto eq = pair.find('=');
+		auto name = Utils::url_decode(pair.substr(0, eq));
+		auto value = eq == std::string::npos ? std::string() : Utils::url_decode(pair.substr(eq + 1));
+		vars[name] = var{ value, DT_STRING };
+	}
+	return vars;
+}
+
+/// <summary>
+/// Render a template once per line of a variable file: batch <template> <vars_file> [--out <pattern>] [--jobs <n>] [--minify] [--trace <out.json>]
+/// </summary>
+int action_batch(int argc, char* argv[]) {
+	if (argc < 4) {
+		Utils::printerr_ln(std::string("Usage: batch <template> <vars_file> [--out <pattern>] [--jobs <n>] [--minify] [--trace <out.json>] ") + Budget::options_usage());
+		return 1;
+	}
+
+	auto path = resolve_input_path(argv[2]);
+	auto vars_path = resolve_input_path(argv[3]);
+
+	// The output pattern may use {{@name}} placeholders from each set and {index} for its position in the file
+	auto output_pattern = Utils::join_path(Utils::file_path_parent(path), Utils::file_name_no_ext(Utils::file_name(path)) + "-{index}.html");
+	xtml::BatchOptions options;
+	std::string trace_path;
+	for (int i = 4; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc) {
+			output_pattern = resolve_input_path(argv[++i]);
+		}
+		else if (arg == "--jobs" && i + 1 < argc) {
+			options.threads = std::stoul(argv[++i]);
+		}
+		else if (arg == "--minify") {
+			Core::minify_options = MinifyOptions::full();
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			Tracer::set_enabled(true);
+			trace_path = resolve_input_path(argv[++i]);
+		}
+		else if (Budget::is_option(arg) && i + 1 < argc) {
+			if (!Budget::set_option(arg, argv[++i], Budget::default_limits)) {
+				Utils::printerr_ln("Error: Invalid value for " + arg + ": " + argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	std::ifstream vars_file(vars_path);
+	if (!vars_file.is_open()) {
+		Utils::printerr_ln("Error: Could not open file: " + vars_path);
+		return 1;
+	}
+
+	xtml::Engine engine(false);
+	init_registry(engine.registry());
+	engine.set_minify_options(Core::minify_options);
+	engine.set_budget_limits(Budget::default_limits);
+	engine.set_logger([](LogLevel, const std::string&) {}); // Per-set messages are noise, failures are reported below
+	auto tpl = engine.compile(path);
+
+	// Sets are read lazily, so only the sets in flight are held in memory
+	auto source = [&](VarMap& vars) {
+		std::string line;
+		while (std::getline(vars_file, line)) {
+			if (!Utils::trim(line).empty()) {
+				vars = parse_var_set(line);
+				return true;
+			}
+		}
+		return false;
+	};
+	auto sink = [&](size_t index, const VarMap& vars, std::string_view output) {
+		auto output_path = Core::resolve_placeholders(Utils::replace(output_pattern, "{index}", std::to_string(index)), vars);
+		auto output_dir = fs::path(output_path).parent_path();
+		if (!output_dir.empty()) {
+			fs::create_directories(output_dir);
+		}
+		Core::write_file(std::string(output), output_path);
+	};
+
+	auto result = engine.render_batch(*tpl, source, sink, options);
+	for (auto& [index, message] : result.errors) {
+		Utils::printerr_ln("Error: Set " + std::to_string(index) + ": " + message);
+	}
+	Utils::print_ln("Rendered " + std::to_string(result.rendered) + " of " + std::to_string(result.rendered + result.errors.size()) + " sets");
+	if (Tracer::enabled() && !write_trace(trace_path)) {
+		return 1;
+	}
+	return result.errors.empty() ? 0 : 1;
+}
+
+/// <summary>
+/// Render pages through Core::build_file and xtml::Engine and compare the outputs:
+/// shadow [<file>...] [--fuzz <n>] [--seed <n>] [--fuzz-dir <dir>] [--minify] [--data <name>=<file>]
+/// </summary>
+int action_shadow(int argc, char* argv[]) {
+	const char* usage = "Usage: shadow [<file>...] [--fuzz <n>] [--seed <n>] [--fuzz-dir <dir>] [--minify] [--data <name>=<file>]";
+	std::vector<std::string> paths;
+	size_t fuzz_count = 0;
+	unsigned seed = 1;
+	std::string fuzz_dir = (fs::temp_directory_path() / "xtml-shadow").string();
+	VarMap vars;
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--fuzz" && i + 1 < argc) {
+			fuzz_count = std::stoul(argv[++i]);
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			seed = std::stoul(argv[++i]);
+		}
+		else if (arg == "--fuzz-dir" && i + 1 < argc) {
+			fuzz_dir = resolve_input_path(argv[++i]);
+		}
+		else if (arg == "--minify") {
+			Core::minify_options = MinifyOptions::full();
+		}
+		else if (arg == "--data" && i + 1 < argc) {
+			load_data_arg(argv[++i], vars);
+		}
+		else if (Utils::starts_with(arg, "--")) {
+			Utils::printerr_ln(usage);
+			return 1;
+		}
+		else {
+			paths.push_back(resolve_input_path(arg));
+		}
+	}
+	if (fuzz_count > 0) {
+		auto fuzz_pages = xtml::Shadow::generate_fuzz_corpus(fuzz_dir, fuzz_count, seed);
+		paths.insert(paths.end(), fuzz_pages.begin(), fuzz_pages.end());
+		Utils::print_ln("Generated " + std::to_string(fuzz_count) + " fuzzed pages in " + fuzz_dir + " (seed " + std::to_string(seed) + ")");
+	}
+	if (paths.empty()) {
+		Utils::printerr_ln(usage);
+		return 1;
+	}
+
+	init_registry();
+	xtml::Engine engine(false);
+	init_registry(engine.registry());
+	engine.set_minify_options(Core::minify_options);
+	engine.set_logger([](LogLevel, const std::string&) {});
+
+	auto legacy = xtml::Shadow::legacy_renderer();
+	auto candidate = xtml::Shadow::engine_renderer(engine);
+	size_t diverged = 0, failed = 0;
+	uint64_t legacy_ns = 0, candidate_ns = 0;
+	for (auto& path : paths) {
+		auto result = xtml::Shadow::compare(path, vars, legacy, candidate);
+		legacy_ns += result.legacy_ns;
+		candidate_ns += result.candidate_ns;
+		if (!result.legacy_error.empty()) {
+			++failed;
+		}
+		if (result.identical) {
+			Utils::log(LL_DEBUG, result.describe());
+		}
+		else {
+			++diverged;
+			Utils::printerr_ln(result.describe());
+		}
+	}
+
+	char summary[160];
+	snprintf(summary, sizeof(summary), "%zu pages, %zu diverged, %zu failed on both paths; legacy %.3f ms, candidate %.3f ms",
+		paths.size(), diverged, failed, legacy_ns / 1e6, candidate_ns / 1e6);
+	Utils::print_ln(summary);
+	return diverged == 0 ? 0 : 1;
+}
+
+/// <summary>
+/// Handle a build request forwarded to the daemon: build <path> [--minify] [--data <name>=<file>]...
+/// Requests run concurrently against the daemon's engine, so templates stay compiled between them.
+/// </summary>
+Daemon::Reply daemon_handle(xtml::Engine& engine, const std::vector<std::string>& args) {
+	Daemon::Reply reply;
+	if (args.size() == 1 && args[0] == "reload") {
+		// Pick up new or changed modules without restarting
+		FunctionRegistry staged;
+		register_functions(staged);
+		engine.registry().Reload(staged);
+		reply.message = "Function registry reloaded.";
+		return reply;
+	}
+	if (args.size() < 2 || args[0] != "build") {
+		reply.ok = false;
+		reply.message = "Unknown daemon request.";
+		return reply;
+	}
+
+	// Messages of this build go back to the client instead of the daemon's output
+	std::string messages;
+	LogFunc log = [&messages](LogLevel, const std::string& message) { messages += message + "\n"; };
+	RenderContext context;
+	context.log = &log;
+	RenderScope scope(context);
+
+	MinifyOptions minify_options;
+	BudgetLimits budget_limits;
+	xtml::RenderOptions options;
+	options.minify_options = &minify_options;
+	options.budget_limits = &budget_limits;
+	options.log = &log;
+	auto& path = args[1];
+	try {
+		VarMap vars;
+		for (size_t i = 2; i < args.size(); ++i) {
+			if (args[i] == "--minify") {
+				minify_options = MinifyOptions::full();
+			}
+			else if (Budget::is_option(args[i]) && i + 1 < args.size()) {
+				if (!Budget::set_option(args[i], args[i + 1], budget_limits)) {
+					reply.ok = false;
+					reply.message = "Error: Invalid value for " + args[i] + ": " + args[i + 1];
+					return reply;
+				}
+				++i;
+			}
+			else if (args[i] == "--data" && i + 1 < args.size()) {
+				load_data_arg(args[++i], vars);
+			}
+		}
+
+		auto output_path = output_path_for(path);
+		auto tpl = engine.compile(path);
+		Core::write_file(engine.render(*tpl, vars, options), output_path);
+		reply.message = messages + "Built " + output_path;
+	}
+	catch (const std::exception& e) {
+		reply.ok = false;
+		reply.message = messages + "Error: Failed to build " + path + ": " + e.what();
+	}
+	return reply;
+}
+
+int action_daemon(int argc, char* argv[]) {
+	auto socket_path = Daemon::socket_path();
+
+	if (argc > 2 && (std::string(argv[2]) == "stop" || std::string(argv[2]) == "reload")) {
+		Daemon::Reply reply;
+		if (!Daemon::send(socket_path, { argv[2] }, reply)) {
+			Utils::printerr_ln("Error: No daemon is running on " + socket_path);
+			return 1;
+		}
+		if (!reply.ok) {
+			Utils::printerr_ln(reply.message);
+			return 1;
+		}
+		Utils::print_ln(reply.message);
+		return 0;
+	}
+
+	// Modules, the function registry and compiled templates stay loaded for all requests
+	xtml::Engine engine(false);
+	init_registry(engine.registry());
+	// Compile failures reach the client through their exception, see daemon_handle
+	engine.set_logger([](LogLevel, const std::string&) {});
+	return Daemon::serve(socket_path, [&engine](const std::vector<std::string>& args) { return daemon_handle(engine, args); });
+}
+
+/// <summary>
+/// Apply the logging options (--log-level <level>, --quiet, --log-json) and remove them from the arguments
+/// </summary>
+bool parse_log_args(int& argc, char* argv[]) {
+	int kept = 1;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--log-level" && i + 1 < argc) {
+			LogLevel level;
+			if (!Logger::parse_level(argv[++i], level)) {
+				Utils::printerr_ln(std::string("Error: Unknown log level: ") + argv[i] + " (expected quiet, info, debug or trace)");
+				return false;
+			}
+			Logger::set_level(level);
+		}
+		else if (arg == "--quiet") {
+			Logger::set_level(LL_ERROR);
+		}
+		else if (arg == "--log-json") {
+			Logger::set_json(true);
+		}
+		else {
+			argv[kept++] = argv[i];
+		}
+	}
+	argc = kept;
+	return true;
 }
 
 int main(int argc, char* argv[])  
 {  
-	auto exe_path = getExeDir();
-	auto modules_path = exe_path + "\\modules";
-	if (!fs::exists(modules_path)) {
-		fs::create_directory(modules_path);
+	if (!parse_log_args(argc, argv)) {
+		return 1;
 	}
-	loadModulesFromFolder(modules_path);
-
-	// Register standard functions
-	ModuleStd stdModule;
-	stdModule.RegisterFunctions(g_functionRegistry);
-	
 
 	if (argc < 2) {  
 		Utils::printerr_ln("Usage: <command> <file_path>");
@@ -104,8 +436,166 @@ int main(int argc, char* argv[])
 		Utils::print_ln(std::string("xtml version: ") + VERSION);
 		return 0;
 	}
+	else if (command == "daemon") {
+		return action_daemon(argc, argv);
+	}
+	else if (command == "batch") {
+		return action_batch(argc, argv);
+	}
+	else if (command == "shadow") {
+		return action_shadow(argc, argv);
+	}
 	else if (command == "build") {
-		action_build(argv[2]);
+		if (argc < 3) {
+			Utils::printerr_ln(std::string("Usage: build <file_path>... [--minify] [--data <name>=<file>] [--profile] [--profile-memory] [--template-profile <out.folded>] [--trace <out.json>] [--no-daemon] ") + Budget::options_usage());
+			return 1;
+		}
+
+		std::vector<std::string> paths;
+		bool use_daemon = true;
+		std::vector<std::string> options;
+		std::vector<std::string> data_args;
+		std::string template_profile_path;
+		std::string trace_path;
+		for (int i = 2; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--minify") {
+				Core::minify_options = MinifyOptions::full();
+				options.push_back(arg);
+			}
+			else if (arg == "--data" && i + 1 < argc) {
+				// Paths are made absolute so the daemon resolves them like this process would
+				std::string data_arg = argv[++i];
+				auto eq = data_arg.find('=');
+				if (eq != std::string::npos) {
+					data_arg = data_arg.substr(0, eq + 1) + resolve_input_path(data_arg.substr(eq + 1));
+				}
+				data_args.push_back(data_arg);
+				options.push_back(arg);
+				options.push_back(data_arg);
+			}
+			else if (arg == "--profile") {
+				// Profiles describe this process, so never forward to the daemon
+				Profiler::set_enabled(true);
+				use_daemon = false;
+			}
+			else if (arg == "--profile-memory") {
+				// Implies --profile, the heap columns are printed next to the stage times
+				Profiler::set_enabled(true);
+				AllocProfiler::set_enabled(true);
+				use_daemon = false;
+			}
+			else if (arg == "--template-profile" && i + 1 < argc) {
+				TemplateProfiler::set_enabled(true);
+				template_profile_path = resolve_input_path(argv[++i]);
+				use_daemon = false;
+			}
+			else if (arg == "--trace" && i + 1 < argc) {
+				Tracer::set_enabled(true);
+				trace_path = resolve_input_path(argv[++i]);
+				use_daemon = false;
+			}
+			else if (arg == "--no-daemon") {
+				use_daemon = false;
+			}
+			else if (Budget::is_option(arg) && i + 1 < argc) {
+				if (!Budget::set_option(arg, argv[++i], Budget::default_limits)) {
+					Utils::printerr_ln("Error: Invalid value for " + arg + ": " + argv[i]);
+					return 1;
+				}
+				options.push_back(arg);
+				options.push_back(argv[i]);
+			}
+			else {
+				paths.push_back(resolve_input_path(arg));
+			}
+		}
+
+		if (paths.empty()) {
+			Utils::printerr_ln("Error: No input file given.");
+			return 1;
+		}
+
+		// A page that fails is reported and the remaining pages are still built
+		size_t total_pages = paths.size();
+		size_t failed = 0;
+		auto report_failures = [&]() {
+			if (failed == 0) return 0;
+			Utils::printerr_ln("Error: " + std::to_string(failed) + " of " + std::to_string(total_pages) + " files failed to build.");
+			return 1;
+		};
+
+		// Forward to a running daemon, fall back to building in this process
+		while (use_daemon && Daemon::is_supported() && !paths.empty()) {
+			std::vector<std::string> request = { "build", paths.front() };
+			request.insert(request.end(), options.begin(), options.end());
+			Daemon::Reply reply;
+			if (!Daemon::send(Daemon::socket_path(), request, reply)) {
+				break;
+			}
+			if (reply.ok) {
+				Utils::print_ln(reply.message);
+			}
+			else {
+				Utils::printerr_ln(reply.message);
+				++failed;
+			}
+			paths.erase(paths.begin());
+		}
+		if (paths.empty()) {
+			return report_failures();
+		}
+
+		init_registry();
+		VarMap vars;
+		for (auto& data_arg : data_args) {
+			load_data_arg(data_arg, vars);
+		}
+
+		ProfileReport total;
+		for (auto& path : paths) {
+			Profiler::thread_report() = ProfileReport();
+			auto start = Profiler::wall_now_ns();
+			AllocMark alloc;
+			if (AllocProfiler::enabled()) alloc.begin();
+			try {
+				action_build(path, vars);
+			}
+			catch (const std::exception& e) {
+				Utils::printerr_ln("Error: Failed to build " + path + ": " + e.what());
+				++failed;
+				continue;
+			}
+			if (Profiler::enabled()) {
+				auto& report = Profiler::thread_report();
+				report.total_wall_ns = Profiler::wall_now_ns() - start;
+				if (AllocProfiler::enabled()) alloc.end(report.total_allocs, report.total_alloc_bytes, report.total_peak_bytes);
+				report.print(path);
+				total.merge(report);
+			}
+		}
+		if (Profiler::enabled() && paths.size() > 1) {
+			total.print(std::to_string(paths.size()) + " files");
+		}
+		if (AllocProfiler::enabled()) {
+			char line[64];
+			snprintf(line, sizeof(line), "Peak live heap: %.1f KB", AllocProfiler::process_peak_bytes() / 1024.0);
+			Utils::print_ln(line);
+		}
+		if (TemplateProfiler::enabled()) {
+			std::ofstream out(template_profile_path);
+			if (!out.is_open()) {
+				Utils::printerr_ln("Error: Could not create file: " + template_profile_path);
+				return 1;
+			}
+			TemplateProfiler::write_collapsed(out);
+			TemplateProfiler::print_summary();
+			Utils::print_ln("Collapsed stacks written to " + template_profile_path);
+		}
+		if (Tracer::enabled() && !write_trace(trace_path)) {
+			return 1;
+		}
+		return report_failures();
 	}
 
 